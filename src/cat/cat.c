@@ -20,22 +20,33 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 // oh welp js realized this exists, been manually
 // defining bool in like the previous 928469 codes (sarcasm)
 #include <errno.h>
 #include <stdbool.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SCAN 1
+#endif
+
 #define PROGRAM_NAME "cat"
 #define PROJECT_NAME "coreutils from scratch"
 #define AUTHORS "Horstaufmental"
 #define VERSION "1.2"
 
-#define BUFSIZE 32768 // GNU Coreutils's buffer size for files
+#define COPY_BUFSIZE (128 * 1024) // what one read() asks for
+#define COPY_CHUNK (1 << 30)      // most the kernel gets asked to move at once
 
 struct help_entry
 {
@@ -51,6 +62,8 @@ static struct option long_options[] = {
     {"squeeze-blank", no_argument, 0, 's'},
     {"show-tabs", no_argument, 0, 'T'},
     {"show-nonprinting", no_argument, 0, 'v'},
+    {"threads", required_argument, 0, 3},
+    {"nocache", optional_argument, 0, 4},
     {"help", no_argument, 0, 1},
     {"version", no_argument, 0, 2},
     {0, no_argument, 0, 'e'}, // -vET
@@ -69,6 +82,11 @@ static struct help_entry help_entries[] = {
     {"-T, --show-tabs", "display TAB characterr as ^I"},
     {"-u", "(ignored) historically means 'unbuffered output', now obsolete"},
     {"-v, --show-nonprinting", "use ^ and M- notation, except for LFD and TAB"},
+    {"    --threads=N", "format big files N slices at a time and, with more\n"
+     "                          than one, open the next files ahead of time;\n"
+     "                          defaults to the number of usable processors"},
+    {"    --nocache[=direct]", "don't leave the files in the page cache; with\n"
+     "                          direct, read regular files with O_DIRECT"},
     {"    --help", "display this help and exit"},
     {"    --version", "output version information and exit"},
     {NULL, NULL}};
@@ -112,67 +130,354 @@ void print_version()
   printf("Written by %s\n", AUTHORS);
 }
 
-static unsigned long long line_number = 1;
+// stdout, looked at once in main()
+static struct stat outStat;
+static bool haveOutStat = false;
 
-void printLineNum(bool isBlank, bool numberAll, bool numberNonBlank)
+// write all of it, whatever the pipe or socket feels like taking at once
+int write_all(const char *buf, size_t len)
 {
-  if (numberNonBlank && isBlank)
-    return;
-  if (numberAll || (numberNonBlank && !isBlank))
+  while (len > 0)
   {
-    printf("%6llu\t", line_number++);
+    ssize_t n = write(STDOUT_FILENO, buf, len);
+    if (n == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      return 1;
+    }
+    buf += n;
+    len -= n;
   }
+  return 0;
 }
 
-void printVis(unsigned char c, bool showNonPrinting)
+/*
+the flags only ever change a few bytes: newlines (for -n, -b, -s and -E),
+tabs (-T) and with -v anything below a space, DEL and everything with the high
+bit set. everything in between those gets copied in one go, the special bytes
+come out of a table worked out once in render_init(), and all of it collects
+in outBuf so there's one write() per OUTBUF_SIZE bytes, not one per byte
+*/
+#define OUTBUF_SIZE (128 * 1024)
+#define ESC_MAX 4 // "M-^?"
+#define DENSE_RUN 8 // plain bytes in a row before it's worth scanning again
+
+// per thread, the --threads workers each render into their own
+static __thread char outBuf[OUTBUF_SIZE];
+static __thread size_t outLen = 0;
+// where out_flush() puts it instead of stdout, a worker's chunk of output
+struct out_sink
+{
+  char *data;
+  size_t len, cap;
+};
+static __thread struct out_sink *outSink = NULL;
+
+static bool renderSqueeze, renderNumberAll, renderNumberNonBlank, renderShowEnds;
+static bool renderPlain;     // no flags at all, nothing to render
+static bool lineSpecial;     // newlines have to be looked at one by one
+static bool special[256];    // stops a plain run
+static unsigned char escLen[256];
+static char esc[256][ESC_MAX];
+
+static __thread unsigned long long line_number = 1;
+
+void sink_append(struct out_sink *sink, const char *p, size_t n)
 {
-  if (!showNonPrinting)
+  if (sink->len + n > sink->cap)
   {
-    putchar(c);
+    size_t cap = sink->cap ? sink->cap : OUTBUF_SIZE;
+    while (cap < sink->len + n)
+      cap *= 2;
+    char *data = realloc(sink->data, cap);
+    if (!data)
+    {
+      fprintf(stderr, "cat: %s\n", strerror(errno));
+      exit(1);
+    }
+    sink->data = data;
+    sink->cap = cap;
+  }
+  memcpy(sink->data + sink->len, p, n);
+  sink->len += n;
+}
+
+void out_flush(void)
+{
+  if (outSink)
+    sink_append(outSink, outBuf, outLen);
+  else if (outLen > 0 && write_all(outBuf, outLen) != 0)
+  {
+    fprintf(stderr, "cat: write error: %s\n", strerror(errno));
+    exit(1);
+  }
+  outLen = 0;
+}
+
+static inline void out_reserve(size_t n)
+{
+  if (outLen + n > OUTBUF_SIZE)
+    out_flush();
+}
+
+void out_bytes(const unsigned char *p, size_t n)
+{
+  // not worth the memcpy, it'd only fill the buffer and go out right away
+  if (n >= OUTBUF_SIZE / 2)
+  {
+    out_flush();
+    if (outSink)
+      sink_append(outSink, (const char *)p, n);
+    else if (write_all((const char *)p, n) != 0)
+    {
+      fprintf(stderr, "cat: write error: %s\n", strerror(errno));
+      exit(1);
+    }
     return;
   }
+  out_reserve(n);
+  memcpy(outBuf + outLen, p, n);
+  outLen += n;
+}
+
+void printLineNum(bool isBlank)
+{
+  if (renderNumberNonBlank && isBlank)
+    return;
+  if (renderNumberAll || (renderNumberNonBlank && !isBlank))
+  {
+    // "%6llu\t" without printf
+    char digits[24];
+    int n = 0;
+    unsigned long long v = line_number++;
+    do
+      digits[n++] = '0' + v % 10;
+    while ((v /= 10) > 0);
+
+    out_reserve(sizeof(digits) + 8);
+    for (int pad = n; pad < 6; pad++)
+      outBuf[outLen++] = ' ';
+    while (n > 0)
+      outBuf[outLen++] = digits[--n];
+    outBuf[outLen++] = '\t';
+  }
+}
 
+// what -v turns c into, "M-" and then whatever c - 128 would be
+size_t escapeVis(unsigned char c, char *out)
+{
   if (c == '\n' || c == '\t')
   {
-    putchar(c);
+    out[0] = c;
+    return 1;
   }
   else if (c < 32)
   {
-    printf("^%c", c + 64); // %@ through ^_
+    out[0] = '^'; // ^@ through ^_
+    out[1] = c + 64;
+    return 2;
   }
   else if (c == 127)
   {
-    fputs("^?", stdout);
+    out[0] = '^';
+    out[1] = '?';
+    return 2;
   }
   else if (c >= 128)
   {
-    fputs("M-", stdout);
-    printVis(c - 128, true);
+    out[0] = 'M';
+    out[1] = '-';
+    return 2 + escapeVis(c - 128, out + 2);
   }
-  else
+  out[0] = c;
+  return 1;
+}
+
+#ifdef HAVE_X86_SCAN
+// which byte classes the table has special ones in, 0 or -1 each: newlines,
+// tabs and -v's (the other control bytes, DEL and the high half)
+static char findNl, findTab, findCtl;
+
+__attribute__((target("avx2"))) const unsigned char *
+find_special_avx2(const unsigned char *p, const unsigned char *end)
+{
+  const __m256i nl = _mm256_set1_epi8('\n'), tab = _mm256_set1_epi8('\t');
+  const __m256i del = _mm256_set1_epi8(127), space = _mm256_set1_epi8(31);
+  const __m256i wantNl = _mm256_set1_epi8(findNl);
+  const __m256i wantTab = _mm256_set1_epi8(findTab);
+  const __m256i wantCtl = _mm256_set1_epi8(findCtl);
+
+  for (; end - p >= 32; p += 32)
   {
-    putchar(c);
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i isNl = _mm256_cmpeq_epi8(v, nl);
+    __m256i isTab = _mm256_cmpeq_epi8(v, tab);
+    // below a space, DEL, or the top bit set (movemask only looks at that)
+    __m256i ctl = _mm256_or_si256(
+        _mm256_cmpeq_epi8(_mm256_max_epu8(v, space), space),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, del), v));
+    ctl = _mm256_andnot_si256(_mm256_or_si256(isNl, isTab), ctl);
+    __m256i m = _mm256_or_si256(
+        _mm256_and_si256(isNl, wantNl),
+        _mm256_or_si256(_mm256_and_si256(isTab, wantTab),
+                        _mm256_and_si256(ctl, wantCtl)));
+    uint32_t bits = _mm256_movemask_epi8(m);
+    if (bits)
+      return p + __builtin_ctz(bits);
   }
+  while (p < end && !special[*p])
+    p++;
+  return p;
 }
 
-int read_fd(int fd, bool showNonPrinting, bool showTabs,
-            bool squeezeBlank, bool outputNumber, bool showEnds,
-            bool numberNoBlank)
+__attribute__((target("sse2"))) const unsigned char *
+find_special_sse2(const unsigned char *p, const unsigned char *end)
 {
-  char buf[BUFSIZE];
-  ssize_t n;
-  bool atLineStart = true;
-  bool prevBlank = false;
+  const __m128i nl = _mm_set1_epi8('\n'), tab = _mm_set1_epi8('\t');
+  const __m128i del = _mm_set1_epi8(127), space = _mm_set1_epi8(31);
+  const __m128i wantNl = _mm_set1_epi8(findNl);
+  const __m128i wantTab = _mm_set1_epi8(findTab);
+  const __m128i wantCtl = _mm_set1_epi8(findCtl);
+
+  for (; end - p >= 16; p += 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i isNl = _mm_cmpeq_epi8(v, nl);
+    __m128i isTab = _mm_cmpeq_epi8(v, tab);
+    __m128i ctl = _mm_or_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, space), space),
+                               _mm_or_si128(_mm_cmpeq_epi8(v, del), v));
+    ctl = _mm_andnot_si128(_mm_or_si128(isNl, isTab), ctl);
+    __m128i m = _mm_or_si128(
+        _mm_and_si128(isNl, wantNl),
+        _mm_or_si128(_mm_and_si128(isTab, wantTab), _mm_and_si128(ctl, wantCtl)));
+    uint32_t bits = _mm_movemask_epi8(m);
+    if (bits)
+      return p + __builtin_ctz(bits);
+  }
+  while (p < end && !special[*p])
+    p++;
+  return p;
+}
+#endif
+
+const unsigned char *find_special_scalar(const unsigned char *p,
+                                         const unsigned char *end)
+{
+  while (p < end && !special[*p])
+    p++;
+  return p;
+}
+
+static const unsigned char *(*find_special)(const unsigned char *,
+                                            const unsigned char *) =
+    find_special_scalar;
+
+void find_special_init(bool showNonPrinting, bool showTabs)
+{
+#ifdef HAVE_X86_SCAN
+  findNl = lineSpecial ? -1 : 0;
+  findTab = showTabs ? -1 : 0;
+  findCtl = showNonPrinting ? -1 : 0;
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    find_special = find_special_avx2;
+  else if (__builtin_cpu_supports("sse2"))
+    find_special = find_special_sse2;
+#else
+  (void)showNonPrinting;
+  (void)showTabs;
+#endif
+}
+
+void render_init(bool showNonPrinting, bool showTabs, bool squeezeBlank,
+                 bool outputNumber, bool showEnds, bool numberNoBlank)
+{
+  renderSqueeze = squeezeBlank;
+  renderNumberAll = outputNumber;
+  renderNumberNonBlank = numberNoBlank;
+  renderShowEnds = showEnds;
+  lineSpecial = squeezeBlank || outputNumber || numberNoBlank || showEnds;
+  renderPlain = !(lineSpecial || showNonPrinting || showTabs);
 
-  while ((n = read(fd, buf, sizeof(buf))) > 0)
+  for (int c = 0; c < 256; c++)
   {
-    for (ssize_t i = 0; i < n; i++)
+    if (c == '\t' && showTabs)
+    {
+      esc[c][0] = '^';
+      esc[c][1] = 'I';
+      escLen[c] = 2;
+    }
+    else if (showNonPrinting)
     {
-      unsigned char c = buf[i];
+      escLen[c] = escapeVis(c, esc[c]);
+    }
+    else
+    {
+      esc[c][0] = c;
+      escLen[c] = 1;
+    }
+    special[c] = escLen[c] != 1 || (unsigned char)esc[c][0] != c ||
+                 (c == '\n' && lineSpecial);
+  }
+  find_special_init(showNonPrinting, showTabs);
+}
 
-      if (c == '\n')
+// one file's worth of line state, carried from one buffer to the next
+struct render_state
+{
+  bool atLineStart;
+  bool prevBlank;
+};
+
+void render(struct render_state *r, const unsigned char *buf, size_t len)
+{
+  const unsigned char *p = buf, *end = buf + len;
+  // copies, so the stores into outBuf don't make the compiler reload them
+  bool atLineStart = r->atLineStart, prevBlank = r->prevBlank;
+
+  while (p < end)
+  {
+    const unsigned char *run = find_special(p, end);
+    if (run > p)
+    {
+      if (atLineStart)
       {
-        if (prevBlank && squeezeBlank)
+        printLineNum(false);
+        atLineStart = false;
+      }
+      prevBlank = false;
+      out_bytes(p, run - p);
+      p = run;
+    }
+
+    // then the escapes, and whatever plain bytes are mixed in with them: in
+    // binary input going back to find_special() for every one of those
+    // costs more than just running them through the table too. olen stands
+    // in for outLen so it doesn't go through memory every byte
+    size_t plain = 0;
+    size_t olen = outLen;
+    while (p < end && plain < DENSE_RUN)
+    {
+      unsigned char c = *p++;
+
+      if (olen > OUTBUF_SIZE - ESC_MAX - 2 || atLineStart)
+      {
+        outLen = olen;
+        out_reserve(ESC_MAX + 2);
+        if (atLineStart && !(c == '\n' && lineSpecial))
+        {
+          printLineNum(false);
+          atLineStart = false;
+          out_reserve(ESC_MAX);
+        }
+        olen = outLen;
+      }
+
+      if (c == '\n' && lineSpecial)
+      {
+        plain = 0;
+        if (prevBlank && renderSqueeze)
         {
           // skip
           continue;
@@ -180,134 +485,566 @@ int read_fd(int fd, bool showNonPrinting, bool showTabs,
 
         if (atLineStart)
         {
-          printLineNum(true, outputNumber, numberNoBlank);
+          outLen = olen;
+          printLineNum(true);
+          out_reserve(2);
+          olen = outLen;
         }
 
-        if (showEnds)
-          putchar('$');
-        putchar('\n');
+        if (renderShowEnds)
+          outBuf[olen++] = '$';
+        outBuf[olen++] = '\n';
 
         prevBlank = true;
         atLineStart = true;
       }
       else
       {
-        if (atLineStart)
-        {
-          printLineNum(false, outputNumber, numberNoBlank);
-          atLineStart = false;
-        }
         prevBlank = false;
-
-        // handle -T and -v
-        if (c == '\t' && showTabs)
-        {
-          fputs("^I", stdout);
-        }
-        else
-        {
-          printVis(c, showNonPrinting);
-        }
+        memcpy(outBuf + olen, esc[c], ESC_MAX);
+        olen += escLen[c];
+        plain = (plain + 1) & ((size_t)special[c] - 1); // 0 after a special
       }
     }
+    outLen = olen;
   }
 
-  if (n == -1)
+  r->atLineStart = atLineStart;
+  r->prevBlank = prevBlank;
+}
+
+/*
+--nocache, for going through a lot of data once without pushing everything
+else out of the page cache: what's been read gets dropped from it every
+NOCACHE_STEP bytes and the next step gets asked for ahead of time, so there's
+about two steps of the file in there at once. with =direct regular files are
+read with O_DIRECT instead and never go through the cache at all, that needs
+the reads aligned so the mmap and kernel copy paths are out
+*/
+#define NOCACHE_ADVISE 1
+#define NOCACHE_DIRECT 2
+#define NOCACHE_STEP (8 * 1024 * 1024)
+#define DIRECT_ALIGN 4096 // covers the logical block size of about anything
+
+static int noCache = 0;
+
+// pos is how far into fd we've read, *dropped how far the cache has been
+// let go of. -1 for an fd that doesn't have offsets
+void drop_behind(int fd, off_t *dropped, off_t pos)
+{
+  if (*dropped < 0 || pos - *dropped < NOCACHE_STEP)
+    return;
+  posix_fadvise(fd, *dropped, pos - *dropped, POSIX_FADV_DONTNEED);
+  posix_fadvise(fd, pos, NOCACHE_STEP, POSIX_FADV_WILLNEED);
+  *dropped = pos;
+}
+
+// where a read loop starts out for drop_behind()
+off_t drop_start(int fd)
+{
+  return noCache ? lseek(fd, 0, SEEK_CUR) : -1;
+}
+
+bool direct_on(int fd)
+{
+  int flags = fcntl(fd, F_GETFL);
+  return flags != -1 && fcntl(fd, F_SETFL, flags | O_DIRECT) == 0;
+}
+
+// O_DIRECT turned a read down (a short read somewhere left the offset
+// unaligned, or the filesystem won't do it after all), go on without it
+bool direct_off(int fd)
+{
+  int flags = fcntl(fd, F_GETFL);
+  return flags != -1 && (flags & O_DIRECT) &&
+         fcntl(fd, F_SETFL, flags & ~O_DIRECT) == 0;
+}
+
+int render_fd(int fd, struct render_state *r)
+{
+  static unsigned char buf[COPY_BUFSIZE] __attribute__((aligned(DIRECT_ALIGN)));
+  off_t pos = drop_start(fd), dropped = pos;
+  ssize_t n;
+
+  while ((n = read(fd, buf, sizeof(buf))) != 0)
   {
-    fprintf(stderr, "cat: %s\n", strerror(errno));
-    return 1;
+    if (n == -1)
+    {
+      if (errno == EINTR || (errno == EINVAL && direct_off(fd)))
+        continue;
+      fprintf(stderr, "cat: %s\n", strerror(errno));
+      return 1;
+    }
+    render(r, buf, n);
+    if (pos >= 0)
+      drop_behind(fd, &dropped, pos += n);
   }
   return 0;
 }
 
-int read_fd_mmap(int fd, size_t file_size, bool showNonPrinting, bool showTabs,
-                 bool squeezeBlank, bool outputNumber, bool showEnds,
-                 bool numberNoBlank)
+int read_fd(int fd)
 {
-  void *data = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
-  if (data == MAP_FAILED)
-    return read_fd(fd, showNonPrinting, showTabs,
-                   squeezeBlank, outputNumber, showEnds,
-                   numberNoBlank);
+  struct render_state r = {.atLineStart = true, .prevBlank = false};
+  return render_fd(fd, &r);
+}
 
-  madvise(data, file_size, MADV_SEQUENTIAL);
-  unsigned char *buf = (unsigned char *)data;
-  bool atLineStart = true;
-  bool prevBlank = false;
+// big files get mapped a window at a time, with the pages behind us dropped
+// as we go, so a file bigger than RAM doesn't end up all resident at once
+#define MAP_WINDOW (256 * 1024 * 1024)
+#define MAP_STEP (16 * 1024 * 1024)
+
+// madvise() wants whole pages, round start down and end up (or down when
+// dropping, a page we're still halfway through stays)
+void advise_pages(unsigned char *from, unsigned char *to, int advice)
+{
+  uintptr_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t)from & ~(page - 1);
+  uintptr_t end = (uintptr_t)to;
+  if (advice == MADV_DONTNEED)
+    end &= ~(page - 1);
+  else
+    end = (end + page - 1) & ~(page - 1);
+  if (end > start)
+    madvise((void *)start, end - start, advice);
+}
+
+int read_fd_mmap(int fd, size_t file_size)
+{
+  struct render_state r = {.atLineStart = true, .prevBlank = false};
+  size_t off = 0;
 
-  for (size_t i = 0; i < file_size; i++)
+  while (off < file_size)
   {
-    unsigned char c = buf[i];
+    size_t wlen = file_size - off < MAP_WINDOW ? file_size - off : MAP_WINDOW;
+    // off is always a multiple of the window, so page aligned too
+    void *data = mmap(NULL, wlen, PROT_READ, MAP_PRIVATE, fd, off);
+    if (data == MAP_FAILED)
+    {
+      if (off > 0 && lseek(fd, off, SEEK_SET) == -1)
+        return 1;
+      return read_fd(fd);
+    }
 
-    if (c == '\n')
+    madvise(data, wlen, MADV_SEQUENTIAL);
+    madvise(data, wlen, MADV_HUGEPAGE); // where the filesystem can
+    unsigned char *buf = (unsigned char *)data;
+
+    for (size_t step = 0; step < wlen; step += MAP_STEP)
     {
-      if (prevBlank && squeezeBlank)
-      {
-        // skip
-        continue;
-      }
+      size_t end = wlen - step < MAP_STEP ? wlen : step + MAP_STEP;
+      // get the next step in while this one gets printed
+      if (end < wlen)
+        advise_pages(buf + end, buf + (wlen - end < MAP_STEP ? wlen : end + MAP_STEP),
+                     MADV_WILLNEED);
+      else if (off + wlen < file_size)
+        posix_fadvise(fd, off + wlen, MAP_STEP, POSIX_FADV_WILLNEED);
 
-      if (atLineStart)
-      {
-        printLineNum(true, outputNumber, numberNoBlank);
-      }
+      render(&r, buf + step, end - step);
+      advise_pages(buf + step, buf + end, MADV_DONTNEED);
+      if (noCache)
+        posix_fadvise(fd, off + step, end - step, POSIX_FADV_DONTNEED);
+    }
+
+    munmap(data, wlen);
+    off += wlen;
+  }
+  return 0;
+}
+
+/*
+--threads: a big file gets mapped nthreads slices of PAR_CHUNK at a time and
+every thread renders one of them. what -n and -b print depends on all the
+lines before, so that takes two passes: the threads count the lines their
+slice is going to number, an exclusive prefix sum over the counts gives every
+slice its first number, then they render into buffers of their own that get
+written out in order. the rest of render()'s state at the start of a slice
+only depends on the byte before it, so the output is the same as the serial
+one byte for byte
+*/
+#define PAR_CHUNK (8 * 1024 * 1024)
+
+static long nthreads = 1;
+
+struct slice_job
+{
+  const unsigned char *buf;
+  size_t len;
+  struct render_state start;
+  unsigned long long lines; // how many it numbers
+  unsigned long long first; // the number the first of those gets
+  struct out_sink out;
+};
+
+// where render() is after prev, anywhere but the very start of the file
+struct render_state state_after(unsigned char prev)
+{
+  bool nl = prev == '\n';
+  return (struct render_state){.atLineStart = nl, .prevBlank = nl};
+}
+
+// how many times render() would call printLineNum() and have it count
+unsigned long long count_numbered(const struct render_state *r,
+                                  const unsigned char *buf, size_t len)
+{
+  // -b never numbers a blank line, -n does unless -s drops it. after the
+  // first line every blank one comes right after a newline, and -s drops
+  // all of those
+  bool blankNumbered = renderNumberAll && !renderNumberNonBlank;
+  bool blanksToo = blankNumbered && !renderSqueeze;
+  const unsigned char *p = buf, *end = buf + len;
+  unsigned long long n = 0;
+
+  if (len == 0)
+    return 0;
+  if (r->atLineStart)
+    n = buf[0] != '\n' || (blankNumbered && !(renderSqueeze && r->prevBlank));
+  while ((p = memchr(p, '\n', end - p)) != NULL && ++p < end)
+    n += blanksToo || *p != '\n';
+  return n;
+}
+
+void *count_slice(void *arg)
+{
+  struct slice_job *job = arg;
+  job->lines = count_numbered(&job->start, job->buf, job->len);
+  return NULL;
+}
+
+void *render_slice(void *arg)
+{
+  struct slice_job *job = arg;
+  struct render_state r = job->start;
+
+  outSink = &job->out;
+  line_number = job->first;
+  render(&r, job->buf, job->len);
+  out_flush();
+  outSink = NULL;
+  return NULL;
+}
 
-      if (showEnds)
-        putchar('$');
-      putchar('\n');
+// jobs 1 to n - 1 get a thread each, the caller does job 0 itself
+void slices_start(void *(*fn)(void *), struct slice_job *jobs, long n,
+                  pthread_t *tids, bool *started)
+{
+  for (long k = 1; k < n; k++)
+    started[k] = pthread_create(&tids[k], NULL, fn, &jobs[k]) == 0;
+}
 
-      prevBlank = true;
-      atLineStart = true;
+void slice_wait(void *(*fn)(void *), struct slice_job *job, pthread_t tid,
+                bool started)
+{
+  if (started)
+    pthread_join(tid, NULL);
+  else
+    fn(job); // couldn't get a thread, do it here
+}
+
+long usable_cpus(void)
+{
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    return CPU_COUNT(&set);
+
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? n : 1;
+}
+
+int read_fd_parallel(int fd, size_t file_size)
+{
+  struct slice_job *jobs = calloc(nthreads, sizeof(*jobs));
+  pthread_t *tids = calloc(nthreads, sizeof(*tids));
+  bool *started = calloc(nthreads, sizeof(*started));
+  if (!jobs || !tids || !started)
+  {
+    free(jobs);
+    free(tids);
+    free(started);
+    return read_fd_mmap(fd, file_size);
+  }
+
+  bool numbering = renderNumberAll || renderNumberNonBlank;
+  struct render_state r = {.atLineStart = true, .prevBlank = false};
+  size_t off = 0;
+  int ret = 0;
+
+  while (off < file_size)
+  {
+    size_t left = file_size - off;
+    size_t wlen = left / PAR_CHUNK < (size_t)nthreads ? left : nthreads * (size_t)PAR_CHUNK;
+    long n = (wlen + PAR_CHUNK - 1) / PAR_CHUNK;
+    // off is always a multiple of PAR_CHUNK, so page aligned too
+    void *data = mmap(NULL, wlen, PROT_READ, MAP_PRIVATE, fd, off);
+    if (data == MAP_FAILED)
+    {
+      ret = lseek(fd, off, SEEK_SET) == -1 ? 1 : render_fd(fd, &r);
+      break;
     }
-    else
+    madvise(data, wlen, MADV_WILLNEED);
+    if (off + wlen < file_size)
+      posix_fadvise(fd, off + wlen, wlen, POSIX_FADV_WILLNEED);
+    const unsigned char *buf = data;
+
+    for (long k = 0; k < n; k++)
     {
-      if (atLineStart)
-      {
-        printLineNum(false, outputNumber, numberNoBlank);
-        atLineStart = false;
-      }
-      prevBlank = false;
+      size_t start = k * (size_t)PAR_CHUNK;
+      jobs[k].buf = buf + start;
+      jobs[k].len = wlen - start < PAR_CHUNK ? wlen - start : PAR_CHUNK;
+      jobs[k].start = k == 0 ? r : state_after(buf[start - 1]);
+      jobs[k].lines = 0;
+    }
 
-      // handle -T and -v
-      if (c == '\t' && showTabs)
-      {
-        fputs("^I", stdout);
-      }
-      else
+    if (numbering)
+    {
+      slices_start(count_slice, jobs, n, tids, started);
+      count_slice(&jobs[0]);
+      for (long k = 1; k < n; k++)
+        slice_wait(count_slice, &jobs[k], tids[k], started[k]);
+    }
+    unsigned long long next = line_number;
+    for (long k = 0; k < n; k++)
+    {
+      jobs[k].first = next;
+      next += jobs[k].lines;
+    }
+
+    // slice 0 goes straight into outBuf behind whatever's already in there,
+    // the others get written as they come in while the rest keep going
+    slices_start(render_slice, jobs, n, tids, started);
+    render(&jobs[0].start, jobs[0].buf, jobs[0].len);
+    out_flush();
+    for (long k = 1; k < n; k++)
+    {
+      slice_wait(render_slice, &jobs[k], tids[k], started[k]);
+      if (write_all(jobs[k].out.data, jobs[k].out.len) != 0)
       {
-        printVis(c, showNonPrinting);
+        fprintf(stderr, "cat: write error: %s\n", strerror(errno));
+        exit(1);
       }
+      jobs[k].out.len = 0; // the buffer's kept for the next window
+    }
+    line_number = next;
+    r = state_after(buf[wlen - 1]);
+
+    munmap(data, wlen);
+    if (noCache)
+      posix_fadvise(fd, off, wlen, POSIX_FADV_DONTNEED);
+    off += wlen;
+  }
+
+  for (long k = 0; k < nthreads; k++)
+    free(jobs[k].out.data);
+  free(started);
+  free(tids);
+  free(jobs);
+  return ret;
+}
+
+// the plain copy for when the kernel can't do it for us
+int copy_plain(int fd)
+{
+  static char buf[COPY_BUFSIZE] __attribute__((aligned(DIRECT_ALIGN)));
+  off_t pos = drop_start(fd), dropped = pos;
+  ssize_t n;
+
+  while ((n = read(fd, buf, sizeof(buf))) != 0)
+  {
+    if (n == -1)
+    {
+      if (errno == EINTR || (errno == EINVAL && direct_off(fd)))
+        continue;
+      return 1;
     }
+    if (write_all(buf, n) != 0)
+      return 1;
+    if (pos >= 0)
+      drop_behind(fd, &dropped, pos += n);
   }
-  munmap(data, file_size);
   return 0;
 }
 
-int read_wrapper(int fd, bool showNonPrinting, bool showTabs,
-                 bool squeezeBlank, bool outputNumber, bool showEnds,
-                 bool numberNoBlank)
+// these mean the call doesn't work for this pair of files, not that
+// something went wrong
+bool not_for_these(int err)
+{
+  return err == EINVAL || err == EXDEV || err == ENOSYS ||
+         err == EOPNOTSUPP || err == EBADF;
+}
+
+// no flags means nothing to render, so the data doesn't have to come through
+// us at all: copy_file_range between regular files, sendfile into a socket,
+// splice into or out of a pipe. all of them move the file offset along, so whenever
+// one gives up the plain copy just carries on from there (that also reads
+// whatever's past the size fstat saw, or files like /proc's that say 0)
+int copy_fd(int fd, const struct stat *st)
+{
+  // smaller bites with --nocache, so there's something to drop in between
+  size_t chunk = noCache ? NOCACHE_STEP : COPY_CHUNK;
+  off_t pos = drop_start(fd), dropped = pos;
+  fflush(stdout);
+
+  while (haveOutStat)
+  {
+    ssize_t n;
+    if (S_ISREG(st->st_mode) && S_ISREG(outStat.st_mode) && st->st_size > 0)
+      n = copy_file_range(fd, NULL, STDOUT_FILENO, NULL, chunk, 0);
+    else if (S_ISFIFO(outStat.st_mode) || S_ISFIFO(st->st_mode))
+      n = splice(fd, NULL, STDOUT_FILENO, NULL, chunk,
+                 SPLICE_F_MOVE | SPLICE_F_MORE);
+    else if (S_ISSOCK(outStat.st_mode) && S_ISREG(st->st_mode))
+      n = sendfile(STDOUT_FILENO, fd, NULL, chunk);
+    else
+      break;
+
+    if (n == 0)
+      break;
+    if (n == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      if (not_for_these(errno))
+        break;
+      return 1;
+    }
+    if (pos >= 0)
+      drop_behind(fd, &dropped, pos += n);
+  }
+  return copy_plain(fd);
+}
+
+int read_wrapper(int fd)
 {
   struct stat st;
+  int ret;
   if (fstat(fd, &st) == -1)
   {
     fprintf(stderr, "cat: %s\n", strerror(errno));
-    return read_fd(fd, showNonPrinting, showTabs,
-                   squeezeBlank, outputNumber, showEnds,
-                   numberNoBlank);
+    ret = read_fd(fd);
+    out_flush();
+    return ret;
   }
 
-  if (S_ISREG(st.st_mode) && st.st_size > 65536)
+  // stdin's flags are shared with whoever handed it to us, leave them be
+  bool direct = noCache == NOCACHE_DIRECT && fd != STDIN_FILENO &&
+                S_ISREG(st.st_mode) && direct_on(fd);
+  if (renderPlain)
   {
-    return read_fd_mmap(fd, st.st_size, showNonPrinting, showTabs,
-                        squeezeBlank, outputNumber, showEnds,
-                        numberNoBlank);
+    ret = direct ? copy_plain(fd) : copy_fd(fd, &st);
+  }
+  else if (!direct && S_ISREG(st.st_mode) && st.st_size > 65536 &&
+           lseek(fd, 0, SEEK_CUR) == 0)
+  {
+    // the mapping starts at 0, a stdin that's been read from already can't
+    // use it. whoever has the fd after us expects to find it at the end
+    if (nthreads > 1 && (size_t)st.st_size >= 2 * PAR_CHUNK)
+      ret = read_fd_parallel(fd, st.st_size);
+    else
+      ret = read_fd_mmap(fd, st.st_size);
+    if (ret == 0)
+      lseek(fd, 0, SEEK_END);
   }
   else
   {
-    return read_fd(fd, showNonPrinting, showTabs,
-                   squeezeBlank, outputNumber, showEnds,
-                   numberNoBlank);
+    ret = read_fd(fd);
+  }
+  out_flush();
+  if (noCache && S_ISREG(st.st_mode))
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED); // the last step's worth
+  return ret;
+}
+
+/*
+with lots of small files the disk sits idle while one of them gets written
+out, and then open() waits on the directory and the inode of the next one. a
+thread of its own opens the files up to PREFETCH_FILES ahead of the one being
+written and has the first PREFETCH_BYTES of each read into the page cache, the
+main loop takes the fds from it in order. only regular files are kept: the
+rest (stdin, fifos, ttys, and anything the thread couldn't open, so the
+error comes out the same) get closed again and left for the main loop to
+open when it gets there
+*/
+#define PREFETCH_FILES 16
+#define PREFETCH_BYTES (2 * 1024 * 1024)
+
+struct prefetch
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond; // both ways, there's only the two of us
+  char **files;
+  int nfiles;
+  int done;  // how many the thread has gone through
+  int taken; // how many the main loop has taken
+  // who's asleep on cond. the thread only gets woken once half the window
+  // is free again, not for every file, that's a context switch each
+  bool threadWaits, mainWaits;
+  int fd[PREFETCH_FILES]; // file i's is in i % PREFETCH_FILES, -1 for none
+};
+
+void *prefetch_files(void *arg)
+{
+  struct prefetch *pf = arg;
+
+  for (int i = 0; i < pf->nfiles; i++)
+  {
+    pthread_mutex_lock(&pf->lock);
+    while (i - pf->taken >= PREFETCH_FILES)
+    {
+      pf->threadWaits = true;
+      pthread_cond_wait(&pf->cond, &pf->lock);
+    }
+    pthread_mutex_unlock(&pf->lock);
+
+    // O_NONBLOCK so a fifo can't leave us stuck in open(), what the fd
+    // turns out to be is what counts, not what the path was a moment ago
+    struct stat st;
+    int fd = -1;
+    if (strcmp(pf->files[i], "-") != 0)
+      fd = open(pf->files[i], O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+    if (fd != -1)
+    {
+      int flags;
+      if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+          (flags = fcntl(fd, F_GETFL)) == -1 ||
+          fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) == -1)
+      {
+        close(fd);
+        fd = -1;
+      }
+      else
+        posix_fadvise(fd, 0, PREFETCH_BYTES, POSIX_FADV_WILLNEED);
+    }
+
+    pthread_mutex_lock(&pf->lock);
+    pf->fd[i % PREFETCH_FILES] = fd;
+    pf->done = i + 1;
+    if (pf->mainWaits)
+    {
+      pf->mainWaits = false;
+      pthread_cond_signal(&pf->cond);
+    }
+    pthread_mutex_unlock(&pf->lock);
+  }
+  return NULL;
+}
+
+// file i's fd, or -1 when it's the main loop's to open
+int prefetch_take(struct prefetch *pf, int i)
+{
+  pthread_mutex_lock(&pf->lock);
+  while (pf->done <= i)
+  {
+    pf->mainWaits = true;
+    pthread_cond_wait(&pf->cond, &pf->lock);
+  }
+  int fd = pf->fd[i % PREFETCH_FILES];
+  pf->taken = i + 1;
+  if (pf->threadWaits && pf->done - pf->taken <= PREFETCH_FILES / 2)
+  {
+    pf->threadWaits = false;
+    pthread_cond_signal(&pf->cond);
   }
+  pthread_mutex_unlock(&pf->lock);
+  return fd;
 }
 
 int main(int argc, char *argv[])
@@ -321,6 +1058,7 @@ int main(int argc, char *argv[])
   bool showEnds = false;        // -E
   bool numberNoBlank = false;   // -b
 
+  nthreads = usable_cpus();
   while ((opt = getopt_long(argc, argv, "AbeEnstTuv", long_options, 0)) != -1)
   {
     switch (opt)
@@ -358,59 +1096,99 @@ int main(int argc, char *argv[])
     case 1:
       print_help(argv[0]);
       return 0;
+    case 3:;
+      char *end;
+      errno = 0;
+      nthreads = strtol(optarg, &end, 10);
+      if (errno || *end != '\0' || end == optarg || nthreads < 1)
+      {
+        fprintf(stderr, "cat: invalid number of threads: '%s'\n", optarg);
+        fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+        return 1;
+      }
+      break;
+    case 4:
+      if (!optarg)
+        noCache = NOCACHE_ADVISE;
+      else if (strcmp(optarg, "direct") == 0)
+        noCache = NOCACHE_DIRECT;
+      else
+      {
+        fprintf(stderr, "cat: invalid argument '%s' for '--nocache'\n", optarg);
+        fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+        return 1;
+      }
+      break;
     case '?':
       fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
       return 1;
     }
   }
 
-  if (argc - optind == 0)
+  haveOutStat = fstat(STDOUT_FILENO, &outStat) == 0;
+  render_init(showNonPrinting, showTabs, squeezeBlank, outputNumber, showEnds,
+              numberNoBlank);
+
+  // no FILE is the same as a lone -
+  static char dash[] = "-";
+  char *stdinOnly[] = {dash};
+  char **files = argc - optind == 0 ? stdinOnly : argv + optind;
+  int nfiles = argc - optind == 0 ? 1 : argc - optind;
+
+  // on a single cpu the thread only gets in the way, and if it can't be had
+  // the loop just opens everything itself. an early return leaves it behind,
+  // exit() takes care of it
+  static struct prefetch pf = {.lock = PTHREAD_MUTEX_INITIALIZER,
+                               .cond = PTHREAD_COND_INITIALIZER};
+  pthread_t prefetcher;
+  pf.files = files;
+  pf.nfiles = nfiles;
+  bool prefetching = nfiles > 1 && nthreads > 1 &&
+                     pthread_create(&prefetcher, NULL, prefetch_files, &pf) == 0;
+
+  for (int i = 0; i < nfiles; i++)
   {
-    char buf[4096];
-    while (true)
+    // stdin goes through the same code as a file, it's just not ours to
+    // close. it gets read again every time - shows up, like GNU's
+    bool isStdin = strcmp(files[i], "-") == 0;
+    int fd = prefetching ? prefetch_take(&pf, i) : -1;
+    if (isStdin)
+      fd = STDIN_FILENO;
+    else if (fd == -1)
+      fd = open(files[i], O_RDONLY);
+    if (fd == -1)
     {
-      fgets(buf, sizeof(buf), stdin);
-      if (feof(stdin))
-        break;
-      write(STDOUT_FILENO, buf, strlen(buf));
+      fprintf(stderr, "cat: cannot open '%s': %s\n", files[i],
+              strerror(errno));
+      return 1;
     }
-  }
-  else
-  {
-    for (; optind < argc; optind++)
+
+    // cat f >> f would never get to the end of f
+    struct stat inStat;
+    if (haveOutStat && S_ISREG(outStat.st_mode) &&
+        fstat(fd, &inStat) == 0 && inStat.st_dev == outStat.st_dev &&
+        inStat.st_ino == outStat.st_ino &&
+        lseek(STDOUT_FILENO, 0, SEEK_CUR) < inStat.st_size)
     {
-      if (strcmp(argv[optind], "-") == 0)
-      {
-        char buf[BUFSIZ];
-        while (true)
-        {
-          fgets(buf, sizeof(buf), stdin);
-          if (feof(stdin))
-            break;
-          write(STDOUT_FILENO, buf, strlen(buf));
-        }
-        continue;
-      }
-      int fd = open(argv[optind], O_RDONLY);
-      if (fd == -1)
-      {
-        fprintf(stderr, "cat: cannot open '%s': %s\n", argv[optind],
-                strerror(errno));
-        return 1;
-      }
+      fprintf(stderr, "cat: '%s': input file is output file\n", files[i]);
+      if (!isStdin)
+        close(fd);
+      return 1;
+    }
 
-      if (read_wrapper(fd, showNonPrinting, showTabs,
-                       squeezeBlank, outputNumber, showEnds,
-                       numberNoBlank) != 0)
-      {
-        fprintf(stderr, "cat: '%s': %s\n", argv[optind],
-                strerror(errno));
+    if (read_wrapper(fd) != 0)
+    {
+      fprintf(stderr, "cat: '%s': %s\n", files[i], strerror(errno));
+      if (!isStdin)
         close(fd);
-        return 1;
-      }
+      return 1;
+    }
 
+    if (!isStdin)
       close(fd);
-    }
   }
+
+  if (prefetching)
+    pthread_join(prefetcher, NULL);
   return 0;
 }
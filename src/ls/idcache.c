@@ -0,0 +1,234 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of coreutils from scratch.
+ * Copyright (c) 2025 Horstaufmental
+ *
+ * coreutils from scratch is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * coreutils from scratch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+#define _GNU_SOURCE
+
+#include <grp.h>
+#include <pwd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "idcache.h"
+
+/*
+`ls -l` wants the owner and group name of every entry, and with NSS going
+out to LDAP or SSSD each getpwuid()/getgrgid() can be a round trip. there are
+only ever a handful of different ids in a directory though, so every id gets
+asked about once and the name is kept in an open addressing table (linear
+probing, never more than half full).
+
+when nsswitch.conf says the database is nothing but "files" there's nobody
+to ask but /etc/passwd and /etc/group anyway, then the whole file gets read
+into the table the first time and NSS isn't loaded at all. anything with
+NIS compat lines (+ and -) in it goes back to asking NSS
+*/
+
+#define IDCACHE_MIN 64
+
+struct idEntry
+{
+    id_t id;
+    bool used;
+    char *name; // NULL: there's no such id
+};
+
+struct idTable
+{
+    struct idEntry *slots;
+    size_t cap;   // a power of two
+    size_t count;
+    bool checked; // has it been decided whether fromFile
+    bool fromFile; // everything there is is in the table already
+};
+
+static struct idTable users, groups;
+
+static size_t idHash(id_t id, size_t cap)
+{
+    return ((uint32_t)id * 0x9E3779B9u) & (cap - 1);
+}
+
+// the slot id is in, or the empty one it would go in
+static struct idEntry *idSlot(struct idEntry *slots, size_t cap, id_t id)
+{
+    size_t i = idHash(id, cap);
+    while (slots[i].used && slots[i].id != id)
+        i = (i + 1) & (cap - 1);
+    return &slots[i];
+}
+
+static struct idEntry *idFind(struct idTable *t, id_t id)
+{
+    if (!t->slots)
+        return NULL;
+    struct idEntry *e = idSlot(t->slots, t->cap, id);
+    return e->used ? e : NULL;
+}
+
+// the first one for an id stays, same as getpwuid() finding the first line.
+// the name is copied, NULL goes in as "no such id"
+static void idPut(struct idTable *t, id_t id, const char *name)
+{
+    if ((t->count + 1) * 2 > t->cap)
+    {
+        size_t cap = t->cap ? t->cap * 2 : IDCACHE_MIN;
+        struct idEntry *slots = calloc(cap, sizeof(*slots));
+        if (!slots)
+            return; // it's only a cache, the next one asks again
+        for (size_t i = 0; i < t->cap; i++)
+            if (t->slots[i].used)
+                *idSlot(slots, cap, t->slots[i].id) = t->slots[i];
+        free(t->slots);
+        t->slots = slots;
+        t->cap = cap;
+    }
+
+    struct idEntry *e = idSlot(t->slots, t->cap, id);
+    if (e->used)
+        return;
+    e->id = id;
+    e->name = name ? strdup(name) : NULL;
+    if (name && !e->name)
+        return; // out of memory, leave the slot empty
+    e->used = true;
+    t->count++;
+}
+
+static void idClear(struct idTable *t)
+{
+    for (size_t i = 0; i < t->cap; i++)
+        free(t->slots[i].name);
+    free(t->slots);
+    t->slots = NULL;
+    t->cap = t->count = 0;
+}
+
+// does nsswitch.conf send the database to nothing but "files"
+static bool filesOnly(const char *db)
+{
+    FILE *f = fopen("/etc/nsswitch.conf", "r");
+    if (!f)
+        return false; // glibc's defaults when it's missing aren't just files
+
+    size_t dbLen = strlen(db);
+    bool only = false;
+    char *line = NULL;
+    size_t size = 0;
+    while (getline(&line, &size, f) != -1)
+    {
+        char *p = line + strspn(line, " \t");
+        if (strncmp(p, db, dbLen) != 0 || p[dbLen] != ':')
+            continue;
+
+        // every service has to be files, [NOTFOUND=return] and friends
+        // don't change where the answers come from
+        int services = 0;
+        only = true;
+        for (char *tok = strtok(p + dbLen + 1, " \t\n"); tok && *tok != '#';
+             tok = strtok(NULL, " \t\n"))
+        {
+            if (*tok == '[')
+                continue;
+            services++;
+            if (strcmp(tok, "files") != 0)
+                only = false;
+        }
+        only = only && services > 0;
+        break;
+    }
+    free(line);
+    fclose(f);
+    return only;
+}
+
+// name:password:id:..., the third field is the id for passwd and group both
+static bool loadFile(struct idTable *t, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+
+    bool ok = true;
+    char *line = NULL;
+    size_t size = 0;
+    while (getline(&line, &size, f) != -1)
+    {
+        if (line[0] == '+' || line[0] == '-')
+        {
+            ok = false; // NIS compat, only NSS knows what that pulls in
+            break;
+        }
+        char *pass = strchr(line, ':');
+        char *idField = pass ? strchr(pass + 1, ':') : NULL;
+        if (line[0] == '#' || !idField)
+            continue;
+        *pass = '\0';
+
+        char *end;
+        unsigned long id = strtoul(idField + 1, &end, 10);
+        if (end == idField + 1 || *end != ':' || id > (id_t)-1)
+            continue;
+        idPut(t, (id_t)id, line);
+    }
+    free(line);
+    fclose(f);
+    if (!ok)
+        idClear(t);
+    return ok;
+}
+
+static void idCheck(struct idTable *t, const char *db, const char *path)
+{
+    if (t->checked)
+        return;
+    t->checked = true;
+    t->fromFile = filesOnly(db) && loadFile(t, path);
+}
+
+const char *uidName(uid_t uid)
+{
+    idCheck(&users, "passwd", "/etc/passwd");
+    struct idEntry *e = idFind(&users, uid);
+    if (e)
+        return e->name;
+    if (users.fromFile)
+        return NULL;
+
+    struct passwd *pw = getpwuid(uid);
+    const char *name = pw ? pw->pw_name : NULL;
+    idPut(&users, uid, name);
+    e = idFind(&users, uid);
+    return e ? e->name : name;
+}
+
+const char *gidName(gid_t gid)
+{
+    idCheck(&groups, "group", "/etc/group");
+    struct idEntry *e = idFind(&groups, gid);
+    if (e)
+        return e->name;
+    if (groups.fromFile)
+        return NULL;
+
+    struct group *gr = getgrgid(gid);
+    const char *name = gr ? gr->gr_name : NULL;
+    idPut(&groups, gid, name);
+    e = idFind(&groups, gid);
+    return e ? e->name : name;
+}
@@ -0,0 +1,28 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of coreutils from scratch.
+ * Copyright (c) 2025 Horstaufmental
+ *
+ * coreutils from scratch is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * coreutils from scratch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+#ifndef IDCACHE_H
+#define IDCACHE_H
+
+#include <sys/types.h>
+
+// the user and group names behind an id, NULL when there's no such one. every
+// id only gets looked up once, the answer (no answer too) is kept for the
+// next file that has it
+const char *uidName(uid_t uid);
+const char *gidName(gid_t gid);
+
+#endif
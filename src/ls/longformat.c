@@ -14,10 +14,13 @@
  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
  * See the GNU General Public License for more details.
  */
-#define _XOPEN_SOURCE 700
+#define _GNU_SOURCE
 
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/statfs.h>
 #include <unistd.h>
@@ -30,9 +33,48 @@
 #include "args.h"
 #include "longformat.h"
 #include "bytetohr.h"
+#include "idcache.h"
 
 #define PATH_MAX 4096
 
+// only what the line below prints, a filesystem that has to go and get the
+// rest (over the network, say) doesn't have to
+#define LONG_STATX_MASK (STATX_TYPE | STATX_MODE | STATX_NLINK | STATX_UID | \
+                         STATX_GID | STATX_SIZE | STATX_MTIME)
+
+/*
+statx() of fileName in dirFd without following a symlink, put into a struct
+stat so the rest doesn't care. the name is looked up relative to the
+directory's fd, the kernel doesn't walk the full path again for every file.
+kernels older than statx() get fstatat()
+*/
+int statLongEntry(int dirFd, const char *fileName, struct stat *st)
+{
+    struct statx stx;
+
+    if (statx(dirFd, fileName, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+              LONG_STATX_MASK, &stx) != 0)
+    {
+        if (errno == ENOSYS)
+            return fstatat(dirFd, fileName, st, AT_SYMLINK_NOFOLLOW);
+        return -1;
+    }
+
+    // some filesystems can't give everything that was asked for, the rest of
+    // stx is garbage then
+    if ((stx.stx_mask & LONG_STATX_MASK) != LONG_STATX_MASK)
+        return fstatat(dirFd, fileName, st, AT_SYMLINK_NOFOLLOW);
+
+    memset(st, 0, sizeof(*st));
+    st->st_mode = stx.stx_mode;
+    st->st_nlink = stx.stx_nlink;
+    st->st_uid = stx.stx_uid;
+    st->st_gid = stx.stx_gid;
+    st->st_size = stx.stx_size;
+    st->st_mtime = stx.stx_mtime.tv_sec;
+    return 0;
+}
+
 /*
 `-l option`
 Selects the long output format which extends the default output of the file name
@@ -69,76 +111,80 @@ File Types:
 Output sizes as so-called human readable by using units of KB, MB, GB instead of
 bytes.
 */
-void printlongOutput(const char *fullPath, const char *fileName)
+void printlongStat(const char *dirPath, const char *fileName,
+                   const struct stat *file_stat, int err)
 {
-    struct stat file_stat;
-
     char fileType;
 
     // TODO: check for network file
-    if (lstat(fullPath, &file_stat) == 0)
+    if (err == 0)
     {
-        if (S_ISREG(file_stat.st_mode))
+        if (S_ISREG(file_stat->st_mode))
         {
             fileType = '-';
         }
-        else if (S_ISDIR(file_stat.st_mode))
+        else if (S_ISDIR(file_stat->st_mode))
         {
             fileType = 'd';
         }
-        else if (S_ISLNK(file_stat.st_mode))
+        else if (S_ISLNK(file_stat->st_mode))
         {
             fileType = 'l';
         }
-        else if (S_ISSOCK(file_stat.st_mode))
+        else if (S_ISSOCK(file_stat->st_mode))
         {
             fileType = 's';
         }
-        else if (S_ISFIFO(file_stat.st_mode))
+        else if (S_ISFIFO(file_stat->st_mode))
         {
             fileType = 'p';
         }
-        else if (S_ISCHR(file_stat.st_mode))
+        else if (S_ISCHR(file_stat->st_mode))
         {
             fileType = 'c';
         }
-        else if (S_ISBLK(file_stat.st_mode))
+        else if (S_ISBLK(file_stat->st_mode))
         {
             fileType = 'b';
         }
     } else {
+        // the stat went by the name alone, the error says which directory
+        char fullPath[PATH_MAX];
+        snprintf(fullPath, sizeof(fullPath), "%s/%s", dirPath, fileName);
+        errno = err;
         perror(fullPath);
         return;
     }
     // printf("filetype %c\n", fileType);
     //  permissions
     char permissions[10];
-    permissions[0] = (file_stat.st_mode & S_IRUSR) ? 'r' : '-';
-    permissions[1] = (file_stat.st_mode & S_IWUSR) ? 'w' : '-';
-    permissions[2] = (file_stat.st_mode & S_IXUSR) ? 'x' : '-';
-    permissions[3] = (file_stat.st_mode & S_IRGRP) ? 'r' : '-';
-    permissions[4] = (file_stat.st_mode & S_IWGRP) ? 'w' : '-';
-    permissions[5] = (file_stat.st_mode & S_IXGRP) ? 'x' : '-';
-    permissions[6] = (file_stat.st_mode & S_IROTH) ? 'r' : '-';
-    permissions[7] = (file_stat.st_mode & S_IWOTH) ? 'w' : '-';
-    permissions[8] = (file_stat.st_mode & S_IXOTH) ? 'x' : '-';
+    permissions[0] = (file_stat->st_mode & S_IRUSR) ? 'r' : '-';
+    permissions[1] = (file_stat->st_mode & S_IWUSR) ? 'w' : '-';
+    permissions[2] = (file_stat->st_mode & S_IXUSR) ? 'x' : '-';
+    permissions[3] = (file_stat->st_mode & S_IRGRP) ? 'r' : '-';
+    permissions[4] = (file_stat->st_mode & S_IWGRP) ? 'w' : '-';
+    permissions[5] = (file_stat->st_mode & S_IXGRP) ? 'x' : '-';
+    permissions[6] = (file_stat->st_mode & S_IROTH) ? 'r' : '-';
+    permissions[7] = (file_stat->st_mode & S_IWOTH) ? 'w' : '-';
+    permissions[8] = (file_stat->st_mode & S_IXOTH) ? 'x' : '-';
     permissions[9] = '\0';
 
     // hard link count
-    nlink_t hardLinkCount = file_stat.st_nlink;
-    // owning user
-    struct passwd *owningUser = getpwuid(file_stat.st_uid);
-    // owning group
-    struct group *owningGroup = getgrgid(file_stat.st_gid);
+    nlink_t hardLinkCount = file_stat->st_nlink;
+    // owning user and group, looked up once per id (see idcache.c)
+    const char *userName = uidName(file_stat->st_uid);
+    const char *groupName = gidName(file_stat->st_gid);
 
     // handle NULL user/group
-    const char *userName = owningUser ? owningUser->pw_name : "unknown";
-    const char *groupName = owningGroup ? owningGroup->gr_name : "unknown";
+    if (!userName)
+        userName = "unknown";
+    if (!groupName)
+        groupName = "unknown";
 
     // file size
-    off_t fileSize = file_stat.st_size;
+    off_t fileSize = file_stat->st_size;
     // last modified timestamp
-    struct tm *modTime = localtime(&file_stat.st_mtime);
+    struct tm *modTime = localtime(&file_stat->st_mtime);
     char timeString[20];
     strftime(timeString, sizeof(timeString), "%b %d %H:%M", modTime);
     // print all info
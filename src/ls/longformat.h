@@ -17,6 +17,13 @@
 #ifndef LONGFORMAT_H
 #define LONGFORMAT_H
 
-void printlongOutput(const char *fullPath, const char *fileName);
+#include <sys/stat.h>
+
+// statLongEntry() stats fileName relative to dirFd, 0 or -1 with errno set.
+// printlongStat() prints its line, or the error instead when err (that errno,
+// 0 when it worked) isn't 0. dirPath is only there for the error message
+int statLongEntry(int dirFd, const char *fileName, struct stat *st);
+void printlongStat(const char *dirPath, const char *fileName,
+                   const struct stat *file_stat, int err);
 
 #endif
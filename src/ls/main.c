@@ -14,9 +14,11 @@
  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
  * See the GNU General Public License for more details.
  */
-#define _XOPEN_SOURCE 700
+#define _GNU_SOURCE
 
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <grp.h>
 #include <limits.h>
@@ -25,6 +27,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/statfs.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <stdbool.h>
@@ -33,6 +36,7 @@
 #include "longformat.h"
 #include "print_help.h"
 #include "print_version.h"
+#include "statpool.h"
 
 struct option long_options[] = {
     {"all", no_argument, 0, 'a'},
@@ -48,6 +52,19 @@ bool includeALLshort = false;
 bool humanReadable = false;
 bool longFormat = false;
 
+// what getdents64() fills the buffer with, glibc doesn't give us the struct
+struct linux_dirent64 {
+  ino64_t d_ino;
+  off64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+// readdir() asks for 32K at a time, a big directory is a lot fewer trips into
+// the kernel with more than that
+#define DENTS_BUF (1024 * 1024)
+
 void getRealPath(char *inputPath, char *realPath) {
   if (realpath(inputPath, realPath) == NULL) {
     perror("realpath");
@@ -56,8 +73,7 @@ void getRealPath(char *inputPath, char *realPath) {
 }
 
 int main(int argc, char *argv[]) {
-  DIR *d;
-  struct dirent *dir;
+  int d = -1;
   int opt;
 
   while ((opt = getopt_long(argc, argv, "aAhl", long_options, 0)) != -1) {
@@ -90,47 +106,84 @@ int main(int argc, char *argv[]) {
 
   if (argc - optind == 0) {
     getRealPath(".", realPath);
-    d = opendir(realPath);
+    d = open(realPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
   } else if (argc - optind == 1) {
     getRealPath(argv[optind], realPath);
-    d = opendir(realPath);
+    d = open(realPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
   } else {
     fprintf(stderr, "Error: please provide only 1 input.\n");
   }
 
-  if (!d) {
+  if (d == -1) {
     perror("opendir");
     return 1;
   }
 
-  while ((dir = readdir(d)) != NULL) {
-    // note to self: continue means to skip over the current item
-    if ((strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0) &&
-        includeALL == false) {
-      // printf("\nskipped over: '%s', bool: %d\n", dir->d_name, includeALL);
-      continue;
-    }
-    if (dir->d_name[0] == '.' &&
-        (includeALL == false && includeALLshort == false)) {
-      // printf("\nskipped over: '%s', -a bool: %d, -A bool: %d\n", dir->d_name,
-      // includeALL, includeALLshort);
-      continue;
+  // the entries come straight out of getdents64() and -l stats them relative
+  // to d, so the kernel doesn't walk the whole path again for every one. -l
+  // does a buffer's worth at a time, all the stats first (see statpool.c)
+  // and then the lines
+  char *dents = malloc(DENTS_BUF);
+  if (!dents) {
+    perror("malloc");
+    return 1;
+  }
+  char **names = NULL;
+  struct stat *sts = NULL;
+  int *errs = NULL;
+  size_t cap = 0;
+  long nread;
+  while ((nread = syscall(SYS_getdents64, d, dents, DENTS_BUF)) != 0) {
+    if (nread == -1) {
+      if (errno == EINTR)
+        continue;
+      perror("getdents64");
+      return 1;
     }
-    if (longFormat) {
-      // deadass thought the issue was entirely on longformat.c, no nigga it was
-      // fucking here lstat needs full path and dir->d_name is just the basename
-      // but we're giving it the d_name
-      char fullPath[PATH_MAX];
-      snprintf(fullPath, sizeof(fullPath), "%s/%s", realPath ? realPath : ".",
-               dir->d_name);
-      printlongOutput(fullPath, dir->d_name);
-      continue;
+    size_t n = 0;
+    for (long pos = 0; pos < nread;) {
+      struct linux_dirent64 *dir = (struct linux_dirent64 *)(dents + pos);
+      pos += dir->d_reclen;
+      // note to self: continue means to skip over the current item
+      if ((strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0) &&
+          includeALL == false) {
+        // printf("\nskipped over: '%s', bool: %d\n", dir->d_name, includeALL);
+        continue;
+      }
+      if (dir->d_name[0] == '.' &&
+          (includeALL == false && includeALLshort == false)) {
+        // printf("\nskipped over: '%s', -a bool: %d, -A bool: %d\n", dir->d_name,
+        // includeALL, includeALLshort);
+        continue;
+      }
+      if (longFormat) {
+        if (n == cap) {
+          cap = cap ? cap * 2 : 1024;
+          names = realloc(names, cap * sizeof(*names));
+          sts = realloc(sts, cap * sizeof(*sts));
+          errs = realloc(errs, cap * sizeof(*errs));
+          if (!names || !sts || !errs) {
+            perror("realloc");
+            return 1;
+          }
+        }
+        names[n++] = dir->d_name;
+        continue;
+      }
+      printf("%s  ", dir->d_name);
     }
-    printf("%s  ", dir->d_name);
+
+    statAll(d, names, sts, errs, n);
+    for (size_t i = 0; i < n; i++)
+      printlongStat(realPath, names[i], &sts[i], errs[i]);
   }
   if (!longFormat)
     printf("\n");
+  free(names);
+  free(sts);
+  free(errs);
+  free(dents);
   free(realPath);
-  closedir(d);
+  close(d);
   return (0);
 }
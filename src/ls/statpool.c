@@ -0,0 +1,86 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of coreutils from scratch.
+ * Copyright (c) 2025 Horstaufmental
+ *
+ * coreutils from scratch is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * coreutils from scratch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "longformat.h"
+#include "statpool.h"
+
+/*
+`ls -l` on a big directory over NFS and the like spends nearly all its time
+waiting on one stat after the other, each a round trip to the server. the
+names get collected first (main.c does a getdents64() buffer at a time) and
+then STAT_THREADS threads take STAT_CHUNK of them at a time off a shared
+counter until they're all done, so there are that many requests in flight
+instead of one. that's about waiting, not cpu, so it's the same number of
+threads no matter how many cpus there are. the printing only starts when the
+whole batch is in, in the same order as always
+*/
+#define STAT_THREADS 16
+#define STAT_CHUNK 32
+// fewer names than this per thread aren't worth starting one for
+#define STAT_MIN_PER_THREAD 64
+
+struct statJob
+{
+    int dirFd;
+    char **names;
+    struct stat *sts;
+    int *errs;
+    size_t n;
+    size_t next; // the first one nobody's taken yet, atomic
+};
+
+static void *statWorker(void *arg)
+{
+    struct statJob *job = arg;
+    size_t start;
+
+    while ((start = __atomic_fetch_add(&job->next, STAT_CHUNK,
+                                       __ATOMIC_RELAXED)) < job->n)
+    {
+        size_t end = job->n - start < STAT_CHUNK ? job->n : start + STAT_CHUNK;
+        for (size_t i = start; i < end; i++)
+            job->errs[i] = statLongEntry(job->dirFd, job->names[i],
+                                         &job->sts[i]) == 0 ? 0 : errno;
+    }
+    return NULL;
+}
+
+void statAll(int dirFd, char **names, struct stat *sts, int *errs, size_t n)
+{
+    struct statJob job = {dirFd, names, sts, errs, n, 0};
+    pthread_t tids[STAT_THREADS];
+    bool started[STAT_THREADS];
+
+    size_t workers = n / STAT_MIN_PER_THREAD;
+    if (workers > STAT_THREADS)
+        workers = STAT_THREADS;
+
+    // this thread is one of them too, whatever couldn't be started just
+    // means fewer of them
+    for (size_t k = 1; k < workers; k++)
+        started[k] = pthread_create(&tids[k], NULL, statWorker, &job) == 0;
+    statWorker(&job);
+    for (size_t k = 1; k < workers; k++)
+        if (started[k])
+            pthread_join(tids[k], NULL);
+}
@@ -0,0 +1,28 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of coreutils from scratch.
+ * Copyright (c) 2025 Horstaufmental
+ *
+ * coreutils from scratch is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * coreutils from scratch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+#ifndef STATPOOL_H
+#define STATPOOL_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+
+// statLongEntry() of every one of names[0..n) relative to dirFd into sts, with
+// errs[i] the errno (0 when it worked). big batches get spread over a few
+// threads, the results are the same as doing them one after the other
+void statAll(int dirFd, char **names, struct stat *sts, int *errs, size_t n);
+
+#endif
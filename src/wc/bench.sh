@@ -0,0 +1,221 @@
+#!/bin/bash
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+# This file is part of coreutils from scratch.
+# Copyright (c) 2025 Horstaufmental
+#
+# coreutils from scratch is free software: you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# any later version.
+#
+# coreutils from scratch is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+# See the GNU General Public License for more details.
+#
+# times wc and cat against the system's GNU ones on seeded corpora, normally
+# run through `cmake --build build --target bench`.
+#
+# every case runs RUNS times and the median counts. the number that gets
+# compared against the baseline is the ratio to GNU, that one stays about the
+# same when the machine changes, the raw GB/s doesn't. without a GNU tool
+# around it falls back to GB/s. a case that's more than THRESHOLD percent
+# worse than the baseline makes the whole thing exit 1.
+
+usage() {
+    cat <<EOF
+Usage: $0 -b BINDIR -g GENERATOR [OPTION]...
+  -b DIR     where the built wc and cat are
+  -g FILE    the random_string corpus generator
+  -d DIR     corpus and results directory (default: ./bench)
+  -r N       runs per case (default: 5)
+  -s SEED    corpus seed (default: 1)
+  -n SIZE    bytes per corpus file, K/M/G work (default: 32M)
+  -B FILE    baseline json to compare against
+  -t PCT     allowed regression against the baseline (default: 10)
+  -u         write the results as the new baseline instead of comparing
+EOF
+}
+
+bindir=""
+gen=""
+dir="bench"
+runs=5
+seed=1
+size=32M
+baseline=""
+threshold=10
+update=0
+
+while getopts "b:g:d:r:s:n:B:t:uh" opt; do
+    case $opt in
+    b) bindir=$OPTARG ;;
+    g) gen=$OPTARG ;;
+    d) dir=$OPTARG ;;
+    r) runs=$OPTARG ;;
+    s) seed=$OPTARG ;;
+    n) size=$OPTARG ;;
+    B) baseline=$OPTARG ;;
+    t) threshold=$OPTARG ;;
+    u) update=1 ;;
+    h) usage; exit 0 ;;
+    *) usage >&2; exit 2 ;;
+    esac
+done
+
+if [ -z "$bindir" ] || [ -z "$gen" ]; then
+    usage >&2
+    exit 2
+fi
+
+# the GNU tools, unless someone points us somewhere else
+gnu_wc=${GNU_WC:-/usr/bin/wc}
+gnu_cat=${GNU_CAT:-/usr/bin/cat}
+for tool in gnu_wc gnu_cat; do
+    if ! "${!tool}" --version 2>/dev/null | grep -q GNU; then
+        echo "$0: no GNU ${tool#gnu_} at ${!tool}, ratios will be missing" >&2
+        eval "$tool="
+    fi
+done
+
+corpus="$dir/corpus"
+stamp="$corpus/.seed-$seed-$size"
+if [ ! -f "$stamp" ]; then
+    echo "Generating corpus (seed $seed, $size bytes per file)..."
+    rm -rf "$corpus"
+    mkdir -p "$corpus" || exit 1
+    "$gen" -s "$seed" -n "$size" "$corpus" >/dev/null || {
+        echo "$0: failed to generate the corpus" >&2
+        exit 1
+    }
+    touch "$stamp"
+fi
+
+# median wall time of running "$@" $runs times, in nanoseconds
+median_ns() {
+    local times=()
+    for ((i = 0; i < runs; i++)); do
+        local start=$(date +%s%N)
+        "$@" >/dev/null 2>&1
+        local end=$(date +%s%N)
+        times+=($((end - start)))
+    done
+    printf "%s\n" "${times[@]}" | sort -n |
+        awk '{ t[NR] = $1 } END { print (NR % 2) ? t[(NR + 1) / 2] : int((t[NR / 2] + t[NR / 2 + 1]) / 2) }'
+}
+
+# name|locale|tool|flags|file
+cases=()
+for file in ascii.txt utf8.txt utf8-ascii-mix.txt; do
+    for flags in "" -l -w -c -m -L; do
+        cases+=("wc|C.UTF-8|wc|$flags|$file")
+    done
+done
+cases+=("wc|C|wc||ascii.txt" "wc|C|wc|-m|utf8.txt")
+for flags in "" -n -A; do
+    cases+=("cat|C.UTF-8|cat|$flags|ascii.txt")
+done
+
+results="$dir/results.json"
+{
+    echo "{"
+    echo "  \"seed\": $seed,"
+    echo "  \"size\": \"$size\","
+    echo "  \"results\": {"
+} >"$results"
+
+printf "%-34s %10s %10s %10s %8s\n" "case" "median s" "GB/s" "GNU GB/s" "ratio"
+n=0
+for c in "${cases[@]}"; do
+    IFS='|' read -r tool loc _ flags file <<<"$c"
+    path="$corpus/$file"
+    bytes=$(stat -c %s "$path")
+    name="$tool${flags:+ $flags} $file $loc"
+    gnu_var="gnu_$tool"
+    gnu=${!gnu_var}
+
+    ns=$(LC_ALL=$loc median_ns "$bindir/$tool" $flags "$path")
+    gnu_ns=""
+    [ -n "$gnu" ] && gnu_ns=$(LC_ALL=$loc median_ns "$gnu" $flags "$path")
+
+    read -r secs gbps gnu_gbps ratio < <(awk -v ns="$ns" -v g="$gnu_ns" -v size="$bytes" 'BEGIN {
+        gbps = size / ns
+        if (g != "") {
+            ggbps = size / g
+            printf "%.4f %.3f %.3f %.3f\n", ns / 1e9, gbps, ggbps, ggbps ? gbps / ggbps : 0
+        } else {
+            printf "%.4f %.3f null null\n", ns / 1e9, gbps
+        }
+    }')
+
+    printf "%-34s %10s %10s %10s %8s\n" "$name" "$secs" "$gbps" "$gnu_gbps" "$ratio"
+    [ $n -gt 0 ] && echo "," >>"$results"
+    printf '    "%s": {"median_s": %s, "gbps": %s, "gnu_gbps": %s, "ratio": %s}' \
+        "$name" "$secs" "$gbps" "$gnu_gbps" "$ratio" >>"$results"
+    n=$((n + 1))
+done
+printf "\n  }\n}\n" >>"$results"
+echo "Results written to $results"
+
+if [ -z "$baseline" ]; then
+    exit 0
+fi
+if [ $update = 1 ]; then
+    cp "$results" "$baseline" && echo "Baseline written to $baseline"
+    exit $?
+fi
+if [ ! -f "$baseline" ]; then
+    echo "No baseline at $baseline yet, store one with -u (or the bench_baseline target)."
+    exit 0
+fi
+
+# one case per line in both files, that's all the json parsing we need
+awk -v threshold="$threshold" '
+function parse(line, out,    name, m) {
+    if (!match(line, /^ *"[^"]*": \{/))
+        return ""
+    name = substr(line, RSTART, RLENGTH)
+    sub(/^ *"/, "", name)
+    sub(/": \{$/, "", name)
+    out["gbps"] = field(line, "gbps")
+    out["ratio"] = field(line, "ratio")
+    return name
+}
+function field(line, key,    v) {
+    if (!match(line, "\"" key "\": [0-9.]+"))
+        return ""
+    v = substr(line, RSTART, RLENGTH)
+    sub(/.*: /, "", v)
+    return v
+}
+FNR == NR {
+    name = parse($0, cur)
+    if (name != "") {
+        base_gbps[name] = cur["gbps"]
+        base_ratio[name] = cur["ratio"]
+    }
+    next
+}
+{
+    name = parse($0, cur)
+    if (name == "" || !(name in base_gbps))
+        next
+    if (cur["ratio"] != "" && base_ratio[name] != "") {
+        what = "ratio"; old = base_ratio[name]; now = cur["ratio"]
+    } else {
+        what = "GB/s"; old = base_gbps[name]; now = cur["gbps"]
+    }
+    if (old > 0 && now < old * (1 - threshold / 100)) {
+        printf "REGRESSION %s: %s %s -> %s (%.1f%% worse)\n", name, what, old, now, (1 - now / old) * 100
+        bad++
+    }
+}
+END {
+    if (bad) {
+        printf "%d case(s) regressed more than %s%%\n", bad, threshold
+        exit 1
+    }
+    printf "No regressions beyond %s%%\n", threshold
+}' "$baseline" "$results"
@@ -0,0 +1,293 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of coreutils from scratch.
+ * Copyright (c) 2025 Horstaufmental
+ *
+ * coreutils from scratch is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * coreutils from scratch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cache.h"
+
+#define CACHE_MAGIC "WCCACHE1"
+// how much of the old tail the fingerprint covers
+#define FP_LEN 4096
+
+struct cache_header {
+  char magic[8];
+  uint32_t entry_size;
+  uint32_t tag;
+  uint64_t count;
+};
+
+struct cache_entry {
+  uint64_t dev, ino;
+  int64_t size; // how far the state goes, not necessarily st_size back then
+  int64_t mtime_sec, mtime_nsec;
+  uint64_t fingerprint;
+  struct wc_state state;
+};
+
+struct wc_cache {
+  char *path;
+  uint32_t tag;
+  pthread_mutex_t lock; // the file pool looks things up from its workers
+  // open addressing on (dev, ino), used slots have ino != 0 || dev != 0
+  struct cache_entry *slots;
+  size_t cap, count;
+  bool dirty;
+};
+
+static void oom(void) {
+  fprintf(stderr, "wc: %s\n", strerror(errno));
+  exit(1);
+}
+
+static size_t hash_key(uint64_t dev, uint64_t ino) {
+  uint64_t h = (dev * 0x9E3779B97F4A7C15ULL) ^ ino;
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static bool slot_used(const struct cache_entry *e) {
+  return e->dev != 0 || e->ino != 0;
+}
+
+static struct cache_entry *find_slot(struct wc_cache *c, uint64_t dev,
+                                     uint64_t ino) {
+  size_t i = hash_key(dev, ino) & (c->cap - 1);
+  while (slot_used(&c->slots[i]) &&
+         (c->slots[i].dev != dev || c->slots[i].ino != ino))
+    i = (i + 1) & (c->cap - 1);
+  return &c->slots[i];
+}
+
+static void insert(struct wc_cache *c, const struct cache_entry *e) {
+  if ((c->count + 1) * 2 > c->cap) {
+    struct cache_entry *old = c->slots;
+    size_t oldcap = c->cap;
+    c->cap = c->cap ? c->cap * 2 : 64;
+    c->slots = calloc(c->cap, sizeof(*c->slots));
+    if (!c->slots)
+      oom();
+    for (size_t i = 0; i < oldcap; i++)
+      if (slot_used(&old[i]))
+        *find_slot(c, old[i].dev, old[i].ino) = old[i];
+    free(old);
+  }
+
+  struct cache_entry *slot = find_slot(c, e->dev, e->ino);
+  if (!slot_used(slot))
+    c->count++;
+  *slot = *e;
+}
+
+// fnv-1a over the FP_LEN bytes before end, false if they can't be read
+static bool fingerprint(int fd, off_t end, uint64_t *out) {
+  unsigned char buf[FP_LEN];
+  off_t start = end > FP_LEN ? end - FP_LEN : 0;
+  size_t want = end - start, got = 0;
+  while (got < want) {
+    ssize_t n = pread(fd, buf + got, want - got, start + got);
+    if (n <= 0) {
+      if (n == -1 && errno == EINTR)
+        continue;
+      return false;
+    }
+    got += n;
+  }
+
+  uint64_t h = 0xCBF29CE484222325ULL;
+  for (size_t i = 0; i < want; i++) {
+    h ^= buf[i];
+    h *= 0x100000001B3ULL;
+  }
+  *out = h;
+  return true;
+}
+
+static bool read_all(int fd, void *buf, size_t len) {
+  size_t got = 0;
+  while (got < len) {
+    ssize_t n = read(fd, (char *)buf + got, len - got);
+    if (n <= 0) {
+      if (n == -1 && errno == EINTR)
+        continue;
+      return false;
+    }
+    got += n;
+  }
+  return true;
+}
+
+static bool write_all(int fd, const void *buf, size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n = write(fd, (const char *)buf + done, len - done);
+    if (n <= 0) {
+      if (n == -1 && errno == EINTR)
+        continue;
+      return false;
+    }
+    done += n;
+  }
+  return true;
+}
+
+struct wc_cache *wc_cache_open(const char *path) {
+  struct wc_cache *c = calloc(1, sizeof(*c));
+  if (!c || !(c->path = strdup(path)))
+    oom();
+  c->tag = wc_kernel_tag();
+  pthread_mutex_init(&c->lock, NULL);
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return c; // first run
+
+  struct cache_header h;
+  if (read_all(fd, &h, sizeof(h)) &&
+      memcmp(h.magic, CACHE_MAGIC, sizeof(h.magic)) == 0 &&
+      h.entry_size == sizeof(struct cache_entry) && h.tag == c->tag) {
+    struct cache_entry e;
+    for (uint64_t i = 0; i < h.count && read_all(fd, &e, sizeof(e)); i++)
+      insert(c, &e);
+  }
+  // a different mode or locale starts over, the file gets replaced on close
+  close(fd);
+  return c;
+}
+
+off_t wc_cache_lookup(struct wc_cache *c, int fd, const struct stat *st,
+                      struct wc_state *state) {
+  wc_state_init(state);
+
+  // cap too, another thread's insert may be growing the table
+  pthread_mutex_lock(&c->lock);
+  if (c->cap == 0) {
+    pthread_mutex_unlock(&c->lock);
+    return 0;
+  }
+  struct cache_entry e = *find_slot(c, st->st_dev, st->st_ino);
+  pthread_mutex_unlock(&c->lock);
+
+  if (!slot_used(&e) || st->st_size < e.size)
+    return 0; // never seen it, or it got truncated
+
+  // same size: only untouched when the mtime is exactly the same too, a
+  // rewrite in the middle keeps the size and the fingerprint doesn't see it
+  if (st->st_size == e.size) {
+    if (st->st_mtim.tv_sec != e.mtime_sec ||
+        st->st_mtim.tv_nsec != e.mtime_nsec)
+      return 0;
+  } else {
+    // it grew, the fingerprint says whether that was just an append
+    uint64_t fp;
+    if (!fingerprint(fd, e.size, &fp) || fp != e.fingerprint)
+      return 0;
+  }
+
+  *state = e.state;
+  return e.size;
+}
+
+void wc_cache_store(struct wc_cache *c, int fd, const struct stat *st,
+                    const struct wc_state *state) {
+  struct cache_entry e = {
+      .dev = st->st_dev,
+      .ino = st->st_ino,
+      .size = state->counts.bytes,
+      .mtime_sec = st->st_mtim.tv_sec,
+      .mtime_nsec = st->st_mtim.tv_nsec,
+      .state = *state,
+  };
+  if (!fingerprint(fd, e.size, &e.fingerprint))
+    return;
+
+  pthread_mutex_lock(&c->lock);
+  insert(c, &e);
+  c->dirty = true;
+  pthread_mutex_unlock(&c->lock);
+}
+
+void wc_cache_close(struct wc_cache *c) {
+  if (c->dirty) {
+    // next to the real one and renamed over it, a reader never sees half
+    size_t len = strlen(c->path) + 32;
+    char *tmp = malloc(len);
+    if (!tmp)
+      oom();
+    snprintf(tmp, len, "%s.%ld", c->path, (long)getpid());
+
+    struct cache_header h = {.entry_size = sizeof(struct cache_entry),
+                             .tag = c->tag,
+                             .count = c->count};
+    memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    bool ok = fd != -1 && write_all(fd, &h, sizeof(h));
+    for (size_t i = 0; ok && i < c->cap; i++)
+      if (slot_used(&c->slots[i]))
+        ok = write_all(fd, &c->slots[i], sizeof(c->slots[i]));
+    if (fd != -1 && close(fd) != 0)
+      ok = false;
+    if (ok && rename(tmp, c->path) == 0) {
+      // done
+    } else {
+      fprintf(stderr, "wc: couldn't write cache %s: %s\n", c->path,
+              strerror(errno));
+      unlink(tmp);
+    }
+    free(tmp);
+  }
+
+  pthread_mutex_destroy(&c->lock);
+  free(c->slots);
+  free(c->path);
+  free(c);
+}
+
+char *wc_cache_default_path(void) {
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  char base[4096];
+
+  if (xdg && xdg[0] == '/')
+    snprintf(base, sizeof(base), "%s", xdg);
+  else if (home && home[0])
+    snprintf(base, sizeof(base), "%s/.cache", home);
+  else
+    return NULL;
+
+  char dir[4096 + 32];
+  snprintf(dir, sizeof(dir), "%s/coreutils-from-scratch", base);
+  // doesn't matter if they're already there
+  mkdir(base, 0700);
+  mkdir(dir, 0700);
+
+  char *path = malloc(strlen(dir) + sizeof("/wc.cache"));
+  if (!path)
+    oom();
+  sprintf(path, "%s/wc.cache", dir);
+  return path;
+}
@@ -0,0 +1,54 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of coreutils from scratch.
+ * Copyright (c) 2025 Horstaufmental
+ *
+ * coreutils from scratch is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * coreutils from scratch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "count.h"
+
+/*
+opt-in (--cache) memory of what wc saw last time, for logs that only ever get
+appended to. every regular file gets an entry keyed by device and inode with
+its size, mtime and the scanner state at the point we stopped reading. next
+time around a file that only grew gets resumed from there, so only the new
+tail has to be read. a fingerprint of the bytes just before the old end makes
+sure it really was an append and not a rewrite. entries only match the same
+counting mode and locale they were made with.
+
+the cache file is a raw dump for this exact binary, anything that doesn't look
+right gets thrown away and rebuilt.
+*/
+struct wc_cache;
+
+// never fails, a missing or broken cache file just means an empty cache
+struct wc_cache *wc_cache_open(const char *path);
+// where the file's cached state is good up to, with that state in *state.
+// 0 and a fresh state when there's nothing usable
+off_t wc_cache_lookup(struct wc_cache *c, int fd, const struct stat *st,
+                      struct wc_state *state);
+// remember state, taken at the end of reading fd (before wc_state_finish())
+void wc_cache_store(struct wc_cache *c, int fd, const struct stat *st,
+                    const struct wc_state *state);
+// writes the cache back if anything changed and frees it
+void wc_cache_close(struct wc_cache *c);
+// $XDG_CACHE_HOME/coreutils-from-scratch/wc.cache or the ~/.cache fallback,
+// malloc'd. NULL if there's no home to put it in
+char *wc_cache_default_path(void);
+
+#endif
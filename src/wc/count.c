@@ -0,0 +1,1260 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of coreutils from scratch.
+ * Copyright (c) 2025 Horstaufmental
+ *
+ * coreutils from scratch is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * coreutils from scratch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <langinfo.h>
+#include <locale.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wctype.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+#include "count.h"
+#include "wc_width_table.h"
+
+/*
+the scanner looks at the input 64 bytes at a time. every block gets turned into
+a handful of bitmasks (one bit per byte) and as long as the block is pure ascii
+the counting is just popcounts and shifts on those masks. only tabs and
+newlines need a closer look, and only when we actually have to track the line
+width. blocks with a high bit byte in them go through the character at a time
+lane.
+
+under a utf-8 locale that lane decodes with its own little dfa and looks the
+width and the "is it a space" answer up in a table that gen_width_table.c built
+from libc at compile time, so it never has to call mbrtowc/iswprint/wcwidth/
+iswspace per character. it accepts exactly what glibc's mbrtowc accepts (up to
+6 byte sequences, no overlongs, no surrogates) and a bad byte still counts as
+one character that belongs to a word but has no width. other multibyte
+locales keep using mbrtowc. in the C locale a high bit byte is exactly that
+kind of bad byte, so those blocks never leave the mask path at all.
+
+without simd the byte loop checks 4k at a time for high bit bytes first and
+runs the pure ascii pages through a loop that doesn't look for them.
+
+the masks are built with avx2 or sse2 depending on what the cpu can do, picked
+at runtime so the binary doesn't need -march=native anymore.
+*/
+
+#define BLOCK 64
+
+struct blockmask {
+  uint64_t hi;  // byte >= 0x80
+  uint64_t nl;  // '\n'
+  uint64_t tab; // '\t'
+  uint64_t sp;  // byte <= ' ' (only meaningful when hi == 0)
+};
+
+static inline bool is_word_seperator(wchar_t wc) {
+  if (iswspace(wc))
+    return true;
+
+  switch (wc) {
+  case 0x00A0:
+  case 0x2007:
+  case 0x202F:
+  case 0x2060:
+    return true;
+  default:
+    return false;
+  }
+}
+
+#ifdef HAVE_X86_KERNELS
+__attribute__((target("sse2"))) static inline void
+classify_sse2(const unsigned char *p, struct blockmask *m) {
+  const __m128i nl = _mm_set1_epi8('\n');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i sp = _mm_set1_epi8(' ' + 1);
+
+  m->hi = m->nl = m->tab = m->sp = 0;
+  for (int j = 0; j < BLOCK; j += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + j));
+    m->hi |= (uint64_t)(uint16_t)_mm_movemask_epi8(v) << j;
+    m->nl |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)) << j;
+    m->tab |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, tab))
+              << j;
+    // signed compare, so high bytes land in here too. they never get looked
+    // at though since those blocks take the slow lane
+    m->sp |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpgt_epi8(sp, v)) << j;
+  }
+}
+
+__attribute__((target("avx2"))) static inline void
+classify_avx2(const unsigned char *p, struct blockmask *m) {
+  const __m256i nl = _mm256_set1_epi8('\n');
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i sp = _mm256_set1_epi8(' ' + 1);
+
+  __m256i lo = _mm256_loadu_si256((const __m256i *)p);
+  __m256i hi = _mm256_loadu_si256((const __m256i *)(p + 32));
+
+#define MASK64(a, b)                                                           \
+  ((uint64_t)(uint32_t)_mm256_movemask_epi8(a) |                               \
+   (uint64_t)(uint32_t)_mm256_movemask_epi8(b) << 32)
+  m->hi = MASK64(lo, hi);
+  m->nl = MASK64(_mm256_cmpeq_epi8(lo, nl), _mm256_cmpeq_epi8(hi, nl));
+  m->tab = MASK64(_mm256_cmpeq_epi8(lo, tab), _mm256_cmpeq_epi8(hi, tab));
+  m->sp = MASK64(_mm256_cmpgt_epi8(sp, lo), _mm256_cmpgt_epi8(sp, hi));
+#undef MASK64
+}
+#endif
+
+// utf-8 decoder states, everything above REJECT still wants more bytes
+enum {
+  U_ACCEPT,
+  U_REJECT,
+  U_NEED1,
+  U_NEED2,
+  U_NEED3,
+  U_NEED4,
+  U_NEED5,
+  U_E0, // next has to be a0-bf, otherwise it's an overlong
+  U_ED, // next has to be 80-9f, otherwise it's a surrogate
+  U_F0, // 90-bf
+  U_F8, // 88-bf
+  U_FC, // 84-bf
+  U_NSTATES
+};
+
+// byte classes, the continuation bytes are split up as far as the first byte
+// after e0/ed/f0/f8/fc needs them to be
+enum {
+  B_ASCII,
+  B_80_83,
+  B_84_87,
+  B_88_8F,
+  B_90_9F,
+  B_A0_BF,
+  B_BAD, // c0, c1, fe, ff
+  B_C2_DF,
+  B_E0,
+  B_E1_EF, // minus ed
+  B_ED,
+  B_F0,
+  B_F1_F7,
+  B_F8,
+  B_F9_FB,
+  B_FC,
+  B_FD,
+  B_NCLASSES
+};
+
+static unsigned char utf8_class[256];
+static unsigned char utf8_lead_mask[256];
+static unsigned char utf8_next[U_NSTATES][B_NCLASSES];
+static bool use_utf8_dfa = false;
+// LC_CTYPE is C/POSIX, every byte is a character of its own
+static bool c_locale = false;
+
+// how much work the kernel has to do, picked from the counters that get
+// printed. every kernel is compiled once per mode so the checks fold away
+enum mode {
+  MODE_BYTES,   // -c alone, nothing to look at
+  MODE_LINES,   // just count '\n', no decoding at all
+  MODE_NOWIDTH, // lines, words and chars but no -L
+  MODE_FULL,
+  MODE_HIST, // -L's work plus the length of every line for --line-histogram
+};
+static enum mode scan_mode = MODE_FULL;
+
+static void utf8_dfa_init(void) {
+  for (int b = 0; b < 256; b++) {
+    unsigned char cls;
+    if (b < 0x80)
+      cls = B_ASCII;
+    else if (b < 0x84)
+      cls = B_80_83;
+    else if (b < 0x88)
+      cls = B_84_87;
+    else if (b < 0x90)
+      cls = B_88_8F;
+    else if (b < 0xA0)
+      cls = B_90_9F;
+    else if (b < 0xC0)
+      cls = B_A0_BF;
+    else if (b < 0xC2)
+      cls = B_BAD;
+    else if (b < 0xE0)
+      cls = B_C2_DF;
+    else if (b == 0xE0)
+      cls = B_E0;
+    else if (b == 0xED)
+      cls = B_ED;
+    else if (b < 0xF0)
+      cls = B_E1_EF;
+    else if (b == 0xF0)
+      cls = B_F0;
+    else if (b < 0xF8)
+      cls = B_F1_F7;
+    else if (b == 0xF8)
+      cls = B_F8;
+    else if (b < 0xFC)
+      cls = B_F9_FB;
+    else if (b == 0xFC)
+      cls = B_FC;
+    else if (b == 0xFD)
+      cls = B_FD;
+    else
+      cls = B_BAD;
+    utf8_class[b] = cls;
+
+    // payload bits of a lead byte
+    if (b >= 0xFC)
+      utf8_lead_mask[b] = 0x01;
+    else if (b >= 0xF8)
+      utf8_lead_mask[b] = 0x03;
+    else if (b >= 0xF0)
+      utf8_lead_mask[b] = 0x07;
+    else if (b >= 0xE0)
+      utf8_lead_mask[b] = 0x0F;
+    else
+      utf8_lead_mask[b] = 0x1F;
+  }
+
+  for (int st = 0; st < U_NSTATES; st++)
+    for (int c = 0; c < B_NCLASSES; c++)
+      utf8_next[st][c] = U_REJECT;
+
+  utf8_next[U_ACCEPT][B_C2_DF] = U_NEED1;
+  utf8_next[U_ACCEPT][B_E0] = U_E0;
+  utf8_next[U_ACCEPT][B_E1_EF] = U_NEED2;
+  utf8_next[U_ACCEPT][B_ED] = U_ED;
+  utf8_next[U_ACCEPT][B_F0] = U_F0;
+  utf8_next[U_ACCEPT][B_F1_F7] = U_NEED3;
+  utf8_next[U_ACCEPT][B_F8] = U_F8;
+  utf8_next[U_ACCEPT][B_F9_FB] = U_NEED4;
+  utf8_next[U_ACCEPT][B_FC] = U_FC;
+  utf8_next[U_ACCEPT][B_FD] = U_NEED5;
+
+  for (int c = B_80_83; c <= B_A0_BF; c++) {
+    utf8_next[U_NEED1][c] = U_ACCEPT;
+    utf8_next[U_NEED2][c] = U_NEED1;
+    utf8_next[U_NEED3][c] = U_NEED2;
+    utf8_next[U_NEED4][c] = U_NEED3;
+    utf8_next[U_NEED5][c] = U_NEED4;
+  }
+  utf8_next[U_E0][B_A0_BF] = U_NEED1;
+  for (int c = B_80_83; c <= B_90_9F; c++)
+    utf8_next[U_ED][c] = U_NEED1;
+  for (int c = B_90_9F; c <= B_A0_BF; c++)
+    utf8_next[U_F0][c] = U_NEED2;
+  for (int c = B_88_8F; c <= B_A0_BF; c++)
+    utf8_next[U_F8][c] = U_NEED3;
+  for (int c = B_84_87; c <= B_A0_BF; c++)
+    utf8_next[U_FC][c] = U_NEED4;
+}
+
+static inline unsigned char cp_class(uint32_t cp) {
+#if WC_HAVE_WIDTH_TABLE
+  if (cp < WC_TABLE_MAX_CP)
+    return wc_table_stage2[wc_table_stage1[cp >> WC_TABLE_SHIFT]]
+                          [cp & WC_TABLE_MASK];
+#else
+  (void)cp;
+#endif
+  return 0; // way past unicode, libc calls these unprintable non-spaces
+}
+
+// a decoded character, never '\n' since that one is always ascii
+static inline void emit_char(struct wc_state *s, uint32_t cp, enum mode mode) {
+  unsigned char cls = cp_class(cp);
+  s->counts.chars++;
+  if (mode >= MODE_FULL)
+    s->curlen += cls & WC_CLASS_WIDTH;
+  if (cls & WC_CLASS_SPACE)
+    s->in_word = false;
+  else if (!s->in_word) {
+    s->counts.words++;
+    s->in_word = true;
+  }
+}
+
+// n bytes that didn't decode, each one is a character of its own with no
+// width, and they're not spaces so they stick to words
+static inline void emit_invalid(struct wc_state *s, size_t n) {
+  if (n == 0)
+    return;
+  s->counts.chars += n;
+  if (!s->in_word) {
+    s->counts.words++;
+    s->in_word = true;
+  }
+}
+
+static inline size_t scan_utf8(struct wc_state *s, const unsigned char *buf,
+                               size_t i, size_t len, enum mode mode) {
+  unsigned char b = buf[i];
+  unsigned char state = utf8_next[U_ACCEPT][utf8_class[b]];
+  uint32_t cp = b & utf8_lead_mask[b];
+  size_t j = i + 1;
+
+  while (state > U_REJECT && j < len) {
+    b = buf[j++];
+    cp = cp << 6 | (b & 0x3F);
+    state = utf8_next[state][utf8_class[b]];
+  }
+
+  if (state == U_ACCEPT) {
+    emit_char(s, cp, mode);
+    return j - i;
+  }
+  if (state == U_REJECT) {
+    // like mbrtowc failing: the lead byte is one bad character and we try
+    // again right after it
+    emit_invalid(s, 1);
+    return 1;
+  }
+
+  // the buffer ended halfway through, wc_scan() picks it back up
+  s->dfa = state;
+  s->cp = cp;
+  s->npend = j - i;
+  return j - i;
+}
+
+// finish the sequence the last buffer ended on, returns how many bytes of
+// this one it used
+static size_t resume_utf8(struct wc_state *s, const unsigned char *buf,
+                          size_t len) {
+  unsigned char state = s->dfa;
+  uint32_t cp = s->cp;
+  size_t j = 0;
+
+  while (state > U_REJECT && j < len) {
+    unsigned char b = buf[j++];
+    cp = cp << 6 | (b & 0x3F);
+    state = utf8_next[state][utf8_class[b]];
+  }
+
+  if (state > U_REJECT) {
+    // tiny buffer, still not done
+    s->dfa = state;
+    s->cp = cp;
+    s->npend += j;
+    if (scan_mode == MODE_HIST)
+      s->curbytes += j;
+    return j;
+  }
+
+  size_t npend = s->npend;
+  s->dfa = U_ACCEPT;
+  s->npend = 0;
+  if (state == U_ACCEPT) {
+    emit_char(s, cp, scan_mode);
+    if (scan_mode == MODE_HIST)
+      s->curbytes += j;
+    return j;
+  }
+  // every byte we held on to is a bad character on its own, the ones from
+  // this buffer get looked at again from scratch
+  emit_invalid(s, npend);
+  return 0;
+}
+
+/*
+--validate runs next to the counting, on the same bytes while they're still in
+cache, so checking a file doesn't mean reading it twice. it goes by RFC 3629,
+not by what mbrtowc lets through, and reports each maximal bad piece once:
+a sequence that gets cut short is one error at its first byte and the byte
+that cut it starts over, a byte that can't start anything is one error.
+
+the avx2 version is the lookup algorithm from Keiser and Lemire's "Validating
+UTF-8 In Less Than One Instruction Per Byte": three table lookups on the
+nibbles of each byte and the one before it catch everything but a missing
+or extra continuation byte, and those come from where the 3 and 4 byte leads
+are. it only answers "is this piece clean", when it isn't the scalar dfa goes
+over the piece again to find out where.
+*/
+
+// like the decoder's states, but only what RFC 3629 allows
+enum {
+  V_ACCEPT,
+  V_REJECT,
+  V_NEED1,
+  V_NEED2,
+  V_NEED3,
+  V_E0, // a0-bf
+  V_ED, // 80-9f
+  V_F0, // 90-bf
+  V_F4, // 80-8f
+  V_NSTATES
+};
+
+static unsigned char valid_next[V_NSTATES][256];
+static size_t validate_max;
+
+typedef void (*validate_fn)(struct wc_state *, const unsigned char *, size_t,
+                            uint64_t);
+static validate_fn validate_kernel = NULL;
+static const char *validate_kernel_name = "none";
+
+static void oom(void) {
+  fprintf(stderr, "wc: %s\n", strerror(errno));
+  exit(1);
+}
+
+static void record_bad(struct wc *c, uint64_t off) {
+  if (c->nbad == validate_max)
+    return;
+  // the capacity is the next power of two, starting at 16
+  if (c->nbad == 0 || (c->nbad >= 16 && (c->nbad & (c->nbad - 1)) == 0)) {
+    uint64_t *bad =
+        realloc(c->bad, (c->nbad ? c->nbad * 2 : 16) * sizeof(*bad));
+    if (!bad)
+      oom();
+    c->bad = bad;
+  }
+  c->bad[c->nbad++] = off;
+}
+
+static void bad_utf8(struct wc_state *s, uint64_t off) {
+  s->counts.invalid++;
+  record_bad(&s->counts, off);
+}
+
+static void validate_init_tables(void) {
+  memset(valid_next, V_REJECT, sizeof(valid_next));
+  for (int b = 0; b < 0x80; b++)
+    valid_next[V_ACCEPT][b] = V_ACCEPT;
+  for (int b = 0xC2; b <= 0xDF; b++)
+    valid_next[V_ACCEPT][b] = V_NEED1;
+  for (int b = 0xE1; b <= 0xEF; b++)
+    valid_next[V_ACCEPT][b] = V_NEED2;
+  valid_next[V_ACCEPT][0xE0] = V_E0;
+  valid_next[V_ACCEPT][0xED] = V_ED;
+  valid_next[V_ACCEPT][0xF0] = V_F0;
+  for (int b = 0xF1; b <= 0xF3; b++)
+    valid_next[V_ACCEPT][b] = V_NEED3;
+  valid_next[V_ACCEPT][0xF4] = V_F4;
+
+  for (int b = 0x80; b <= 0xBF; b++) {
+    valid_next[V_NEED1][b] = V_ACCEPT;
+    valid_next[V_NEED2][b] = V_NEED1;
+    valid_next[V_NEED3][b] = V_NEED2;
+    valid_next[V_E0][b] = b >= 0xA0 ? V_NEED1 : V_REJECT;
+    valid_next[V_ED][b] = b <= 0x9F ? V_NEED1 : V_REJECT;
+    valid_next[V_F0][b] = b >= 0x90 ? V_NEED2 : V_REJECT;
+    valid_next[V_F4][b] = b <= 0x8F ? V_NEED2 : V_REJECT;
+  }
+}
+
+// base is the offset of buf[0] in the whole input
+static void validate_scalar(struct wc_state *s, const unsigned char *buf,
+                            size_t len, uint64_t base) {
+  unsigned char state = s->vdfa;
+  size_t i = 0;
+
+  while (i < len) {
+    if (state == V_ACCEPT) {
+      // plain ascii a word at a time
+      for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, buf + i, sizeof(w));
+        if (w & 0x8080808080808080ULL)
+          break;
+      }
+      if (i == len)
+        break;
+    }
+
+    unsigned char next = valid_next[state][buf[i]];
+    if (next == V_REJECT && state != V_ACCEPT) {
+      // cut short, this byte gets another go as the start of something new
+      bad_utf8(s, s->vstart);
+      state = V_ACCEPT;
+      continue;
+    }
+    if (next == V_REJECT)
+      bad_utf8(s, base + i);
+    else if (state == V_ACCEPT && next != V_ACCEPT)
+      s->vstart = base + i;
+    state = next == V_REJECT ? V_ACCEPT : next;
+    i++;
+  }
+  s->vdfa = state;
+}
+
+static void flush_validate(struct wc_state *s) {
+  if (s->vdfa != V_ACCEPT) {
+    bad_utf8(s, s->vstart);
+    s->vdfa = V_ACCEPT;
+  }
+}
+
+#ifdef HAVE_X86_KERNELS
+#define AVX2 __attribute__((target("avx2")))
+
+// what each nibble lookup says could be wrong, an error is a bit that all
+// three of them agree on
+#define TOO_SHORT (1 << 0)  // lead followed by something that isn't 10xxxxxx
+#define TOO_LONG (1 << 1)   // ascii followed by 10xxxxxx
+#define OVERLONG_3 (1 << 2) // e0 80-9f
+#define TOO_LARGE (1 << 3)  // past U+10FFFF
+#define SURROGATE (1 << 4)  // ed a0-bf
+#define OVERLONG_2 (1 << 5) // c0/c1
+#define TOO_LARGE_1000 (1 << 6)
+#define OVERLONG_4 (1 << 6) // f0 80-8f
+// 10xxxxxx 10xxxxxx, fine after a 3 or 4 byte lead. bit 7, as a char
+#define TWO_CONTS (-0x80)
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+#define TABLE16(...) _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+
+// the byte n positions before each one in in, prev is the block before
+#define PREV(in, prev, n)                                                      \
+  _mm256_alignr_epi8(in, _mm256_permute2x128_si256(prev, in, 0x21), 16 - (n))
+
+AVX2 static inline __m256i utf8_errors_avx2(__m256i in, __m256i prev) {
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  const __m256i byte_1_high = TABLE16(
+      TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+      TOO_LONG, TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+      TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,
+      TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+  const __m256i byte_1_low = TABLE16(
+      CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2, CARRY,
+      CARRY, CARRY | TOO_LARGE, CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+      CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000);
+  const __m256i byte_2_high = TABLE16(
+      TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+      TOO_SHORT, TOO_SHORT,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 |
+          OVERLONG_4,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, TOO_SHORT,
+      TOO_SHORT, TOO_SHORT, TOO_SHORT);
+
+  __m256i prev1 = PREV(in, prev, 1);
+  __m256i sc = _mm256_and_si256(
+      _mm256_and_si256(
+          _mm256_shuffle_epi8(byte_1_high, _mm256_and_si256(
+                                               _mm256_srli_epi16(prev1, 4), nibble)),
+          _mm256_shuffle_epi8(byte_1_low, _mm256_and_si256(prev1, nibble))),
+      _mm256_shuffle_epi8(byte_2_high,
+                          _mm256_and_si256(_mm256_srli_epi16(in, 4), nibble)));
+
+  // two continuations in a row are only fine right after a 3 or 4 byte
+  // lead, and there they're a must
+  __m256i third = _mm256_subs_epu8(PREV(in, prev, 2), _mm256_set1_epi8(0xE0 - 0x80));
+  __m256i fourth = _mm256_subs_epu8(PREV(in, prev, 3), _mm256_set1_epi8(0xF0 - 0x80));
+  __m256i must23 = _mm256_and_si256(_mm256_or_si256(third, fourth),
+                                    _mm256_set1_epi8((char)0x80));
+  return _mm256_xor_si256(must23, sc);
+}
+
+AVX2 static void validate_avx2(struct wc_state *s, const unsigned char *buf,
+                               size_t len, uint64_t base) {
+  size_t i = 0;
+  // finish whatever the last piece left open, the blocks start clean
+  for (; s->vdfa != V_ACCEPT && i < len; i++)
+    validate_scalar(s, buf + i, 1, base + i);
+
+  // a lead byte in the last 3 positions that needs more than what's left
+  const __m256i max = _mm256_setr_epi8(
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char)(0xF0 - 1),
+      (char)(0xE0 - 1), (char)(0xC0 - 1));
+  size_t start = i;
+  __m256i prev = _mm256_setzero_si256();
+  __m256i err = _mm256_setzero_si256();
+  __m256i incomplete = _mm256_setzero_si256();
+  for (; i + 32 <= len; i += 32) {
+    __m256i in = _mm256_loadu_si256((const __m256i *)(buf + i));
+    if (_mm256_movemask_epi8(in) == 0) {
+      err = _mm256_or_si256(err, incomplete);
+      incomplete = _mm256_setzero_si256();
+    } else {
+      err = _mm256_or_si256(err, utf8_errors_avx2(in, prev));
+      incomplete = _mm256_subs_epu8(in, max);
+    }
+    prev = in;
+  }
+
+  if (!_mm256_testz_si256(err, err)) {
+    // something's wrong in there, the slow way finds out what and where
+    validate_scalar(s, buf + start, len - start, base + start);
+    return;
+  }
+
+  // clean up to i, except maybe for a sequence that's still open at the
+  // end. back up to where it starts and do it along with the leftovers
+  size_t j = i;
+  for (int k = 0; k < 3 && j > start && (buf[j - 1] & 0xC0) == 0x80; k++)
+    j--;
+  if (j > start && buf[j - 1] >= 0xC0)
+    j--;
+  validate_scalar(s, buf + j, len - j, base + j);
+}
+
+#undef TOO_SHORT
+#undef TOO_LONG
+#undef OVERLONG_3
+#undef TOO_LARGE
+#undef SURROGATE
+#undef OVERLONG_2
+#undef TOO_LARGE_1000
+#undef OVERLONG_4
+#undef TWO_CONTS
+#undef CARRY
+#undef TABLE16
+#undef PREV
+#undef AVX2
+#endif
+
+static inline unsigned hist_bucket(uint64_t v) {
+  if (v < 2 * WC_HIST_SUB)
+    return v;
+  unsigned top = 63 - __builtin_clzll(v);
+  // the top bit and the 3 below it
+  return (top - 3) * WC_HIST_SUB + (v >> (top - 3));
+}
+
+// the longest length that still lands in bucket b
+static uint64_t hist_bucket_top(unsigned b) {
+  if (b < 2 * WC_HIST_SUB)
+    return b;
+  unsigned shift = b / WC_HIST_SUB - 1;
+  uint64_t lo = (uint64_t)(b % WC_HIST_SUB + WC_HIST_SUB) << shift;
+  return lo + ((1ULL << shift) - 1);
+}
+
+static inline void hist_put(struct wc_lenhist *h, uint64_t len) {
+  h->n[hist_bucket(len)]++;
+  if (len > h->max)
+    h->max = len;
+}
+
+// a line just ended, curlen and curbytes are how long it was
+static void hist_line(struct wc_state *s) {
+  struct wc_hist *h = s->counts.hist;
+  if (!h && !(h = s->counts.hist = calloc(1, sizeof(*h))))
+    oom();
+  h->lines++;
+  hist_put(&h->bytes, s->curbytes);
+  hist_put(&h->width, s->curlen);
+  s->curbytes = 0;
+}
+
+struct wc_hist *wc_hist_merge(struct wc_hist *into,
+                              const struct wc_hist *from) {
+  if (!into && !(into = calloc(1, sizeof(*into))))
+    oom();
+  if (!from)
+    return into;
+  into->lines += from->lines;
+  for (unsigned b = 0; b < WC_HIST_BUCKETS; b++) {
+    into->bytes.n[b] += from->bytes.n[b];
+    into->width.n[b] += from->width.n[b];
+  }
+  if (from->bytes.max > into->bytes.max)
+    into->bytes.max = from->bytes.max;
+  if (from->width.max > into->width.max)
+    into->width.max = from->width.max;
+  return into;
+}
+
+// nearest rank: the shortest length at least pct percent of the lines don't
+// go over, as far as the buckets can tell
+static uint64_t hist_percentile(const struct wc_lenhist *h, uint64_t lines,
+                                unsigned pct) {
+  uint64_t rank = (lines * pct + 99) / 100;
+  uint64_t seen = 0;
+  for (unsigned b = 0; b < WC_HIST_BUCKETS; b++) {
+    seen += h->n[b];
+    if (seen >= rank) {
+      uint64_t top = hist_bucket_top(b);
+      return top < h->max ? top : h->max;
+    }
+  }
+  return h->max;
+}
+
+void wc_hist_percentiles(struct wc *w) {
+  static const unsigned pcts[] = {50, 90, 99};
+  memset(w->line_pct, 0, sizeof(w->line_pct));
+  const struct wc_hist *h = w->hist;
+  if (!h || h->lines == 0)
+    return;
+
+  const struct wc_lenhist *which[] = {&h->bytes, &h->width};
+  size_t *out = w->line_pct;
+  for (int k = 0; k < 2; k++) {
+    for (int i = 0; i < 3; i++)
+      *out++ = hist_percentile(which[k], h->lines, pcts[i]);
+    *out++ = which[k]->max;
+  }
+}
+
+static void flush_pending(struct wc_state *s) {
+  if (s->dfa != U_ACCEPT) {
+    emit_invalid(s, s->npend);
+    s->dfa = U_ACCEPT;
+    s->npend = 0;
+  }
+  flush_validate(s);
+}
+
+// one ascii byte, no decoder involved
+static inline void scan_ascii(struct wc_state *s, unsigned char c,
+                              enum mode mode) {
+  const bool width = mode >= MODE_FULL;
+  s->counts.chars++;
+
+  if (c == '\n') {
+    s->counts.lines++;
+    if (width && s->curlen > s->counts.maxlen)
+      s->counts.maxlen = s->curlen;
+    if (mode == MODE_HIST)
+      hist_line(s);
+    s->curlen = 0;
+    s->in_word = false;
+    return;
+  }
+
+  if (mode == MODE_HIST)
+    s->curbytes++;
+  if (c == '\t') {
+    if (width)
+      s->curlen += 8 - (s->curlen % 8);
+    s->in_word = false;
+  } else {
+    if (width)
+      s->curlen++;
+    if (c <= ' ')
+      s->in_word = false;
+    else if (!s->in_word) {
+      s->counts.words++;
+      s->in_word = true;
+    }
+  }
+}
+
+// one character starting at buf[i], exactly what the old loops did per byte.
+// returns how many bytes it ate
+static inline size_t scan_char(struct wc_state *s, const unsigned char *buf,
+                               size_t i, size_t len, enum mode mode) {
+  unsigned char c = buf[i];
+  const bool width = mode >= MODE_FULL;
+
+  if (c < 0x80) {
+    scan_ascii(s, c, mode);
+    return 1;
+  }
+
+  // the C locale is plain ascii, libc refuses anything above it. same as a
+  // bad byte anywhere else, no need to ask mbrtowc about it
+  if (c_locale) {
+    emit_invalid(s, 1);
+    if (mode == MODE_HIST)
+      s->curbytes++;
+    return 1;
+  }
+
+  if (use_utf8_dfa) {
+    size_t n = scan_utf8(s, buf, i, len, mode);
+    if (mode == MODE_HIST)
+      s->curbytes += n;
+    return n;
+  }
+
+  // other multibyte locales
+  size_t clen = 1;
+  wchar_t wc = 0;
+
+  size_t result = mbrtowc(&wc, (const char *)(buf + i), len - i, &s->mbs);
+  if (result == (size_t)-1 || result == (size_t)-2) {
+    // the state is undefined after an error, start over at the next byte
+    memset(&s->mbs, 0, sizeof(s->mbs));
+    clen = 1;
+    wc = 0;
+  } else {
+    clen = result;
+  }
+
+  s->counts.chars++;
+
+  if (wc == L'\n' || wc == L'\r') {
+    if (wc == L'\n')
+      s->counts.lines++;
+    if (width && s->curlen > s->counts.maxlen)
+      s->counts.maxlen = s->curlen;
+    if (mode == MODE_HIST && wc == L'\n')
+      hist_line(s);
+    else if (mode == MODE_HIST)
+      s->curbytes += clen;
+    s->curlen = 0;
+    s->in_word = false;
+  } else {
+    if (mode == MODE_HIST)
+      s->curbytes += clen;
+    if (width && iswprint(wc)) {
+      int width = wcwidth(wc);
+      if (width > 0)
+        s->curlen += width;
+    }
+
+    if (is_word_seperator(wc))
+      s->in_word = false;
+    else if (!s->in_word) {
+      s->counts.words++;
+      s->in_word = true;
+    }
+  }
+  return clen;
+}
+
+#ifdef HAVE_X86_KERNELS
+// bits lo..hi-1 of a block mask
+static inline uint64_t bits_between(size_t lo, size_t hi) {
+  uint64_t below_hi = hi >= BLOCK ? ~0ULL : (1ULL << hi) - 1;
+  uint64_t below_lo = lo >= BLOCK ? ~0ULL : (1ULL << lo) - 1;
+  return below_hi & ~below_lo;
+}
+
+// all of the block logic, the only things that change between kernels are how
+// the masks get built and which counters we bother with. always_inline so
+// every kernel gets its own copy with all of that folded in
+enum isa { ISA_SSE2, ISA_AVX2 };
+
+static inline __attribute__((always_inline)) void
+scan_blocks(struct wc_state *st, const unsigned char *buf, size_t len,
+            enum isa isa, enum mode mode) {
+  struct wc_state s = *st;
+  size_t i = 0;
+
+  while (i + BLOCK <= len) {
+    struct blockmask m;
+    if (isa == ISA_AVX2)
+      classify_avx2(buf + i, &m);
+    else
+      classify_sse2(buf + i, &m);
+
+    if (mode == MODE_LINES) {
+      s.counts.lines += __builtin_popcountll(m.nl);
+      i += BLOCK;
+      continue;
+    }
+
+    if (m.hi && !c_locale) {
+      // something non-ascii in here, walk it the slow way. a multibyte
+      // sequence can run past the block end, that's fine, the next block
+      // just starts wherever it stopped
+      size_t end = i + BLOCK;
+      while (i < end)
+        i += scan_char(&s, buf, i, len, mode);
+      continue;
+    }
+
+    // in the C locale a high bit byte is a character that sticks to words
+    // and takes up no room, the masks can deal with that just fine
+    uint64_t narrow = ~m.hi; // bytes that take up a column
+    m.sp &= narrow;
+
+    s.counts.chars += BLOCK;
+    s.counts.lines += __builtin_popcountll(m.nl);
+
+    // a word starts wherever a non-space byte follows a space byte (or
+    // follows the end of a word that was still open from the last block)
+    uint64_t word = ~m.sp;
+    uint64_t starts = word & ~((word << 1) | (uint64_t)s.in_word);
+    s.counts.words += __builtin_popcountll(starts);
+    s.in_word = word >> 63;
+
+    uint64_t special = m.nl | m.tab;
+    const bool hist = mode == MODE_HIST;
+    if (mode < MODE_FULL) {
+      // no -L, nobody cares about the width
+    } else if (!special) {
+      s.curlen += m.hi ? __builtin_popcountll(narrow) : BLOCK;
+      if (hist)
+        s.curbytes += BLOCK;
+    } else {
+      size_t last = 0;
+      while (special) {
+        size_t p = __builtin_ctzll(special);
+        special &= special - 1;
+        s.curlen += m.hi ? __builtin_popcountll(narrow & bits_between(last, p))
+                         : p - last;
+        if (hist)
+          s.curbytes += p - last;
+        if (m.nl >> p & 1) {
+          if (s.curlen > s.counts.maxlen)
+            s.counts.maxlen = s.curlen;
+          if (hist)
+            hist_line(&s);
+          s.curlen = 0;
+        } else {
+          s.curlen += 8 - (s.curlen % 8);
+          if (hist)
+            s.curbytes++;
+        }
+        last = p + 1;
+      }
+      s.curlen += m.hi ? __builtin_popcountll(narrow & bits_between(last, BLOCK))
+                       : BLOCK - last;
+      if (hist)
+        s.curbytes += BLOCK - last;
+    }
+    i += BLOCK;
+  }
+
+  // leftovers that don't fill a block
+  if (mode == MODE_LINES) {
+    for (; i < len; i++)
+      s.counts.lines += buf[i] == '\n';
+  }
+  while (i < len)
+    i += scan_char(&s, buf, i, len, mode);
+
+  s.counts.bytes += len;
+  *st = s;
+}
+
+#endif
+
+// the byte loop checks a whole page for high bit bytes up front, most input
+// is plain ascii and then the per byte "is this ascii" test can go
+#define ASCII_BLOCK 4096
+
+static inline bool all_ascii(const unsigned char *p, size_t n) {
+  uint64_t acc = 0;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint64_t w;
+    memcpy(&w, p + i, sizeof(w));
+    acc |= w;
+  }
+  for (; i < n; i++)
+    acc |= p[i];
+  return !(acc & 0x8080808080808080ULL);
+}
+
+// no simd at all, the plain old byte loop
+static inline __attribute__((always_inline)) void
+scan_bytewise(struct wc_state *st, const unsigned char *buf, size_t len,
+              enum mode mode) {
+  struct wc_state s = *st;
+  if (mode == MODE_LINES) {
+    // libc's memchr is still way faster than looking at every byte
+    const unsigned char *p = buf, *end = buf + len;
+    while ((p = memchr(p, '\n', end - p)) != NULL) {
+      s.counts.lines++;
+      p++;
+    }
+  } else {
+    size_t i = 0;
+    while (i < len) {
+      size_t end = len - i > ASCII_BLOCK ? i + ASCII_BLOCK : len;
+      if (all_ascii(buf + i, end - i)) {
+        for (; i < end; i++)
+          scan_ascii(&s, buf[i], mode);
+      } else {
+        // can run a few bytes past end, the next block starts from there
+        while (i < end)
+          i += scan_char(&s, buf, i, len, mode);
+      }
+    }
+  }
+  s.counts.bytes += len;
+  *st = s;
+}
+
+typedef void (*scan_fn)(struct wc_state *, const unsigned char *, size_t);
+
+#define KERNEL(name, attr, call)                                               \
+  attr static void name(struct wc_state *st, const unsigned char *buf,         \
+                        size_t len) {                                          \
+    call;                                                                      \
+  }
+
+KERNEL(scalar_lines, , scan_bytewise(st, buf, len, MODE_LINES))
+KERNEL(scalar_nowidth, , scan_bytewise(st, buf, len, MODE_NOWIDTH))
+KERNEL(scalar_full, , scan_bytewise(st, buf, len, MODE_FULL))
+KERNEL(scalar_hist, , scan_bytewise(st, buf, len, MODE_HIST))
+
+#ifdef HAVE_X86_KERNELS
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2,popcnt,bmi")))
+KERNEL(sse2_lines, SSE2, scan_blocks(st, buf, len, ISA_SSE2, MODE_LINES))
+KERNEL(sse2_nowidth, SSE2, scan_blocks(st, buf, len, ISA_SSE2, MODE_NOWIDTH))
+KERNEL(sse2_full, SSE2, scan_blocks(st, buf, len, ISA_SSE2, MODE_FULL))
+KERNEL(sse2_hist, SSE2, scan_blocks(st, buf, len, ISA_SSE2, MODE_HIST))
+KERNEL(avx2_lines, AVX2, scan_blocks(st, buf, len, ISA_AVX2, MODE_LINES))
+KERNEL(avx2_nowidth, AVX2, scan_blocks(st, buf, len, ISA_AVX2, MODE_NOWIDTH))
+KERNEL(avx2_full, AVX2, scan_blocks(st, buf, len, ISA_AVX2, MODE_FULL))
+KERNEL(avx2_hist, AVX2, scan_blocks(st, buf, len, ISA_AVX2, MODE_HIST))
+#undef SSE2
+#undef AVX2
+#endif
+#undef KERNEL
+
+struct kernel_set {
+  const char *name;
+  scan_fn fn[MODE_HIST + 1]; // MODE_BYTES never gets here
+};
+
+static const struct kernel_set scalar_kernels = {
+    "scalar", {NULL, scalar_lines, scalar_nowidth, scalar_full, scalar_hist}};
+#ifdef HAVE_X86_KERNELS
+static const struct kernel_set sse2_kernels = {
+    "sse2", {NULL, sse2_lines, sse2_nowidth, sse2_full, sse2_hist}};
+static const struct kernel_set avx2_kernels = {
+    "avx2", {NULL, avx2_lines, avx2_nowidth, avx2_full, avx2_hist}};
+#endif
+
+static const char *mode_names[] = {"bytes only", "lines only", "no width",
+                                   "full", "full, line histogram"};
+
+static scan_fn scan_kernel = scalar_full;
+static const char *scan_kernel_name = "scalar";
+
+void wc_kernel_init(unsigned need) {
+  utf8_dfa_init();
+#if WC_HAVE_WIDTH_TABLE
+  use_utf8_dfa = strcmp(nl_langinfo(CODESET), "UTF-8") == 0;
+#endif
+  const char *loc = setlocale(LC_CTYPE, NULL);
+  c_locale = loc && (strcmp(loc, "C") == 0 || strcmp(loc, "POSIX") == 0);
+
+  if (need & WC_NEED_HIST)
+    scan_mode = MODE_HIST;
+  else if (need & WC_NEED_WIDTH)
+    scan_mode = MODE_FULL;
+  else if (need & (WC_NEED_WORDS | WC_NEED_CHARS))
+    scan_mode = MODE_NOWIDTH;
+  else if (need & WC_NEED_LINES)
+    scan_mode = MODE_LINES;
+  else
+    scan_mode = MODE_BYTES;
+
+  const struct kernel_set *set = &scalar_kernels;
+#ifdef HAVE_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    set = &avx2_kernels;
+  else if (__builtin_cpu_supports("sse2"))
+    set = &sse2_kernels;
+#endif
+
+  scan_kernel_name = set->name;
+  scan_kernel = scan_mode == MODE_BYTES ? NULL : set->fn[scan_mode];
+}
+
+const char *wc_kernel_name(void) { return scan_kernel_name; }
+const char *wc_kernel_mode(void) { return mode_names[scan_mode]; }
+// the validator has to see the bytes, even when nothing else does
+bool wc_bytes_only(void) { return scan_mode == MODE_BYTES && !validate_kernel; }
+
+uint32_t wc_kernel_tag(void) {
+  uint32_t h = 2166136261u;
+  for (const char *p = nl_langinfo(CODESET); *p; p++)
+    h = (h ^ (unsigned char)*p) * 16777619u;
+  h = (h ^ scan_mode) * 16777619u;
+  h = (h ^ (use_utf8_dfa | c_locale << 1 | !!validate_kernel << 2)) * 16777619u;
+  return h;
+}
+
+void wc_validate_init(size_t max) {
+  validate_init_tables();
+  validate_max = max;
+  validate_kernel = validate_scalar;
+  validate_kernel_name = "scalar";
+#ifdef HAVE_X86_KERNELS
+  if (__builtin_cpu_supports("avx2")) {
+    validate_kernel = validate_avx2;
+    validate_kernel_name = "avx2";
+  }
+#endif
+}
+
+const char *wc_validate_name(void) { return validate_kernel_name; }
+
+void wc_state_init(struct wc_state *st) {
+  memset(st, 0, sizeof(*st));
+}
+
+static void scan(struct wc_state *st, const unsigned char *buf, size_t len) {
+  if (scan_mode == MODE_BYTES) {
+    st->counts.bytes += len;
+    return;
+  }
+  if (st->dfa != U_ACCEPT) {
+    size_t used = resume_utf8(st, buf, len);
+    st->counts.bytes += used;
+    buf += used;
+    len -= used;
+  }
+  scan_kernel(st, buf, len);
+}
+
+// small enough that the validator still finds it in L2 after the counting
+#define VALIDATE_STEP (64 * 1024)
+
+void wc_scan(struct wc_state *st, const unsigned char *buf, size_t len) {
+  if (!validate_kernel) {
+    scan(st, buf, len);
+    return;
+  }
+  while (len > 0) {
+    size_t n = len < VALIDATE_STEP ? len : VALIDATE_STEP;
+    uint64_t base = st->counts.bytes;
+    scan(st, buf, n);
+    validate_kernel(st, buf, n, base);
+    buf += n;
+    len -= n;
+  }
+}
+
+struct wc wc_state_finish(struct wc_state *st) {
+  flush_pending(st);
+  // the last line counts even without a newline, same as awk's last record
+  if (scan_mode == MODE_HIST && st->curbytes)
+    hist_line(st);
+  if (st->curlen > st->counts.maxlen)
+    st->counts.maxlen = st->curlen;
+  st->curlen = 0;
+  return st->counts;
+}
+
+bool wc_can_split(void) {
+  return MB_CUR_MAX == 1 || strcmp(nl_langinfo(CODESET), "UTF-8") == 0;
+}
+
+size_t wc_sync_point(const unsigned char *buf, size_t len, size_t pos) {
+  // utf-8 continuation bytes are 10xxxxxx, anything else is either ascii or
+  // a lead byte and the serial scan is always at a character boundary there
+  while (pos < len && (buf[pos] & 0xC0) == 0x80)
+    pos++;
+  return pos;
+}
+
+void wc_count_part(struct wc_part *p, const unsigned char *buf, size_t len) {
+  memset(p, 0, sizeof(*p));
+  if (len == 0)
+    return;
+
+  struct wc_state s;
+  wc_state_init(&s);
+
+  // does the first character carry on a word the previous part left open?
+  struct wc_state probe;
+  wc_state_init(&probe);
+  scan_char(&probe, buf, 0, len, MODE_NOWIDTH);
+  p->first_word = probe.in_word;
+
+  const unsigned char *nl = memchr(buf, '\n', len);
+  size_t headlen = nl ? (size_t)(nl - buf) : len;
+  const unsigned char *tab = memchr(buf, '\t', headlen);
+
+  if (tab) {
+    size_t pre = tab - buf;
+    wc_scan(&s, buf, pre);
+    flush_pending(&s);
+    p->head_pre = s.curlen;
+
+    // the tab itself, then carry on from column 0
+    s.counts.chars++;
+    s.counts.bytes++;
+    s.in_word = false;
+    s.curlen = 0;
+    wc_scan(&s, tab + 1, headlen - pre - 1);
+    flush_pending(&s);
+    p->head_post = s.curlen;
+    p->head_tab = true;
+  } else {
+    wc_scan(&s, buf, headlen);
+    flush_pending(&s);
+    p->head_pre = s.curlen;
+  }
+
+  if (nl) {
+    p->has_nl = true;
+    s.counts.lines++;
+    s.counts.chars++;
+    s.counts.bytes++;
+    s.in_word = false;
+    s.curlen = 0;
+    s.curbytes = 0;
+    wc_scan(&s, nl + 1, len - headlen - 1);
+    flush_pending(&s);
+    p->tail = s.curlen;
+    p->tail_bytes = s.curbytes;
+  }
+  p->head_bytes = headlen;
+
+  p->in_word = s.in_word;
+  p->counts = s.counts;
+}
+
+void wc_merge_part(struct wc_state *st, const struct wc_part *p) {
+  if (p->counts.bytes == 0)
+    return;
+
+  // the part's offsets start at its own beginning
+  st->counts.invalid += p->counts.invalid;
+  for (size_t i = 0; i < p->counts.nbad; i++)
+    record_bad(&st->counts, st->counts.bytes + p->counts.bad[i]);
+  free(p->counts.bad);
+
+  st->counts.lines += p->counts.lines;
+  st->counts.words += p->counts.words;
+  if (st->in_word && p->first_word)
+    st->counts.words--; // same word, already counted
+  st->counts.chars += p->counts.chars;
+  st->counts.bytes += p->counts.bytes;
+
+  size_t col = st->curlen;
+  if (p->head_tab)
+    col = ((col + p->head_pre) / 8 + 1) * 8 + p->head_post;
+  else
+    col += p->head_pre;
+
+  if (p->has_nl) {
+    if (col > st->counts.maxlen)
+      st->counts.maxlen = col;
+    if (p->counts.maxlen > st->counts.maxlen)
+      st->counts.maxlen = p->counts.maxlen;
+    if (scan_mode == MODE_HIST) {
+      // the line that was still open before this part ends in it
+      st->curlen = col;
+      st->curbytes += p->head_bytes;
+      hist_line(st);
+      st->counts.hist = wc_hist_merge(st->counts.hist, p->counts.hist);
+      free(p->counts.hist);
+    }
+    st->curlen = p->tail;
+    st->curbytes = p->tail_bytes;
+  } else {
+    st->curlen = col;
+    st->curbytes += p->head_bytes;
+  }
+  st->in_word = p->in_word;
+}
@@ -0,0 +1,135 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of coreutils from scratch.
+ * Copyright (c) 2025 Horstaufmental
+ *
+ * coreutils from scratch is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * coreutils from scratch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+#ifndef COUNT_H
+#define COUNT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+// --line-histogram: how long the lines are, in bytes and in display columns.
+// the first 16 buckets are exact, after that every power of two gets split in
+// 8, so a percentile read off it is at most 1/8 too high
+#define WC_HIST_SUB 8
+#define WC_HIST_BUCKETS (62 * WC_HIST_SUB)
+struct wc_lenhist {
+  uint64_t n[WC_HIST_BUCKETS];
+  uint64_t max;
+};
+struct wc_hist {
+  uint64_t lines;
+  struct wc_lenhist bytes, width;
+};
+// p50, p90, p99 and max of the bytes, then the same for the width
+#define WC_HIST_COLUMNS 8
+
+struct wc {
+  size_t lines, words, chars, bytes, maxlen;
+  // --validate only: how many invalid utf-8 sequences there were, and where
+  // the first few of them start (malloc'd, whoever gets the struct frees it)
+  size_t invalid;
+  uint64_t *bad;
+  size_t nbad;
+  // --line-histogram only: every line's length (malloc'd like bad, NULL until
+  // the first line ends) and what wc_hist_percentiles() read off it
+  struct wc_hist *hist;
+  size_t line_pct[WC_HIST_COLUMNS];
+};
+
+// everything the scanner needs to carry from one buffer to the next
+struct wc_state {
+  struct wc counts;
+  size_t curlen;
+  size_t curbytes; // only kept up with for --line-histogram
+  bool in_word;
+  mbstate_t mbs;
+  // utf-8 sequence cut off at the end of the last buffer
+  unsigned char dfa;   // decoder state, 0 when nothing is pending
+  unsigned char npend; // how many of its bytes we've seen so far
+  uint32_t cp;         // what's been decoded of it so far
+  // same for the --validate check, which goes by the strict rules
+  unsigned char vdfa;
+  uint64_t vstart; // offset of the sequence vdfa is in the middle of
+};
+
+// which counters are going to get printed, the kernel skips the rest
+#define WC_NEED_LINES (1 << 0)
+#define WC_NEED_WORDS (1 << 1)
+#define WC_NEED_CHARS (1 << 2)
+#define WC_NEED_WIDTH (1 << 3)
+#define WC_NEED_HIST (1 << 4)
+
+// picks the widest kernel the running cpu supports and the cheapest variant
+// of it that still gets the needed counters right. call once from main()
+// after setlocale(), counters that aren't needed come out as garbage
+void wc_kernel_init(unsigned need);
+const char *wc_kernel_name(void);
+const char *wc_kernel_mode(void);
+// nothing but -c, a regular file's size is the answer
+bool wc_bytes_only(void);
+// identifies the mode and locale the kernel was set up for, a wc_state is
+// only any good to a kernel with the same tag
+uint32_t wc_kernel_tag(void);
+
+// --validate: check the input is utf-8 by RFC 3629 (so no 5 and 6 byte
+// forms, whatever the locale thinks) in the same pass as the counting. every
+// invalid sequence counts once in wc.invalid and the offsets of the first max
+// of them go in wc.bad. call after wc_kernel_init()
+void wc_validate_init(size_t max);
+const char *wc_validate_name(void);
+
+// adds from's lines to into, which gets allocated when it's NULL
+struct wc_hist *wc_hist_merge(struct wc_hist *into, const struct wc_hist *from);
+// fills in w->line_pct from w->hist, all zeroes when there were no lines
+void wc_hist_percentiles(struct wc *w);
+
+void wc_state_init(struct wc_state *st);
+void wc_scan(struct wc_state *st, const unsigned char *buf, size_t len);
+struct wc wc_state_finish(struct wc_state *st);
+
+/*
+a slice of a bigger file counted on its own, as if it started at the beginning
+of a line outside of a word. wc_merge_part() glues it back onto whatever came
+before it, and the result is the same as if the whole thing got scanned in one
+go. the one thing a part can't know is the column it starts at, so the width of
+its first line is kept split around its first tab (tabs snap to a multiple of
+8, after that the starting column doesn't matter anymore).
+*/
+struct wc_part {
+  struct wc counts;  // maxlen and hist only cover lines that start and end in here
+  bool first_word;   // first character belongs to a word
+  bool has_nl;
+  bool head_tab;     // first line has a tab in it
+  size_t head_pre;   // width of the first line up to its first tab
+  size_t head_post;  // width after that tab, counted from column 0
+  size_t tail;       // width of the unterminated last line, if has_nl
+  size_t head_bytes; // bytes in the first line, the tail's go in tail_bytes
+  size_t tail_bytes;
+  bool in_word;      // still inside a word at the end
+};
+
+// true when the locale's encoding lets us cut the input anywhere that isn't
+// in the middle of a character (utf-8 and single byte charsets)
+bool wc_can_split(void);
+// first position at or after pos where a character can start
+size_t wc_sync_point(const unsigned char *buf, size_t len, size_t pos);
+void wc_count_part(struct wc_part *p, const unsigned char *buf, size_t len);
+// takes over p's list of bad offsets and its histogram
+void wc_merge_part(struct wc_state *st, const struct wc_part *p);
+
+#endif
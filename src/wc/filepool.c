@@ -0,0 +1,339 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of coreutils from scratch.
+ * Copyright (c) 2025 Horstaufmental
+ *
+ * coreutils from scratch is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * coreutils from scratch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "filepool.h"
+#include "uring.h"
+
+// files in flight per worker, enough to keep everyone busy while the main
+// thread is stuck on a slow one at the front of the line
+#define SLOTS_PER_WORKER 4
+
+// with io_uring a worker takes this many files at once and opens, stats,
+// reads and closes all of them with one io_uring_enter() per step. anything
+// that doesn't fit in one buffer goes through count() like before
+#define URING_BATCH 32
+#define URING_BUF (64 * 1024)
+
+struct slot {
+  struct file_result res;
+  bool done;
+};
+
+struct file_pool {
+  pthread_mutex_t lock;
+  pthread_cond_t work; // workers wait here for names
+  pthread_cond_t done; // the main thread waits here for results
+
+  struct slot *slots;
+  size_t cap;
+  // running counters, slot index is counter % cap
+  size_t head;  // next one to hand back
+  size_t claim; // next one a worker picks up
+  size_t tail;  // next free one
+  bool closing;
+
+  struct wc (*count)(int fd);
+  pthread_t *tids;
+  long nworkers;
+  size_t batch;        // slots taken at once, 1 without io_uring
+  struct batch *local; // file_pool_next()'s own when there are no workers
+};
+
+// one per worker, the buffers get reused for every batch
+struct batch {
+  struct uring *ring;
+  unsigned char *bufs; // URING_BATCH * URING_BUF
+  struct batch_file {
+    struct file_result *res;
+    int fd;
+    bool small;   // regular and fits in its buffer, the ring reads it
+    bool counted; // no need for count() anymore
+    int got;      // what the read returned
+    struct statx stx;
+  } files[URING_BATCH];
+};
+
+static void count_one(struct file_pool *pool, struct file_result *res) {
+  int fd = open(res->name, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    res->err = errno;
+    return;
+  }
+  res->err = 0;
+  res->counts = pool->count(fd);
+  close(fd);
+}
+
+static struct batch *batch_open(void) {
+  struct uring *ring = uring_open(URING_BATCH);
+  if (!ring)
+    return NULL;
+  struct batch *b = calloc(1, sizeof(*b));
+  unsigned char *bufs = malloc((size_t)URING_BATCH * URING_BUF);
+  if (!b || !bufs) {
+    free(b);
+    free(bufs);
+    uring_close(ring);
+    return NULL;
+  }
+  b->ring = ring;
+  b->bufs = bufs;
+  return b;
+}
+
+static void batch_close(struct batch *b) {
+  if (!b)
+    return;
+  uring_close(b->ring);
+  free(b->bufs);
+  free(b);
+}
+
+static void opened(void *arg, uint64_t i, int res) {
+  struct batch_file *f = &((struct batch *)arg)->files[i];
+  f->fd = res < 0 ? -1 : res;
+  f->res->err = res < 0 ? -res : 0;
+}
+
+static void statted(void *arg, uint64_t i, int res) {
+  struct batch_file *f = &((struct batch *)arg)->files[i];
+  // /proc and friends claim to be empty, those need the read-to-eof path
+  f->small = res == 0 && S_ISREG(f->stx.stx_mode) && f->stx.stx_size > 0;
+}
+
+static void got_read(void *arg, uint64_t i, int res) {
+  ((struct batch *)arg)->files[i].got = res;
+}
+
+static void closed(void *arg, uint64_t i, int res) {
+  (void)arg, (void)i, (void)res;
+}
+
+static void ring_broke(void) {
+  fprintf(stderr, "wc: io_uring: %s\n", strerror(errno));
+  exit(1);
+}
+
+static void count_batch(struct file_pool *pool, struct batch *b,
+                        struct file_result **res, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    b->files[i] = (struct batch_file){.res = res[i], .fd = -1};
+    uring_openat(b->ring, res[i]->name, O_RDONLY | O_CLOEXEC, i);
+  }
+  if (uring_run(b->ring, opened, b) == -1)
+    ring_broke();
+
+  for (size_t i = 0; i < n; i++)
+    if (b->files[i].fd != -1)
+      uring_statx(b->ring, b->files[i].fd, &b->files[i].stx, i);
+  if (uring_run(b->ring, statted, b) == -1)
+    ring_broke();
+
+  // -c alone only needs the size, same shortcut as cw_wrapper()
+  bool bytes_only = wc_bytes_only();
+  for (size_t i = 0; i < n; i++) {
+    struct batch_file *f = &b->files[i];
+    if (f->small && bytes_only) {
+      f->res->counts = (struct wc){.bytes = f->stx.stx_size};
+      f->counted = true;
+      continue;
+    }
+    f->small = f->small && f->stx.stx_size < URING_BUF;
+    // asking for the whole buffer, more than statx said is there, so a
+    // short read means we got to the end. at offset 0 so the file position
+    // doesn't move if it turns out to have grown and count() has to do it
+    if (f->small)
+      uring_read(b->ring, f->fd, b->bufs + i * URING_BUF, URING_BUF, 0, i);
+  }
+  if (uring_run(b->ring, got_read, b) == -1)
+    ring_broke();
+
+  for (size_t i = 0; i < n; i++) {
+    struct batch_file *f = &b->files[i];
+    if (f->fd == -1)
+      continue;
+    if (f->small && !f->counted && f->got >= 0 && f->got < URING_BUF) {
+      struct wc_state state;
+      wc_state_init(&state);
+      wc_scan(&state, b->bufs + i * URING_BUF, f->got);
+      f->res->counts = wc_state_finish(&state);
+    } else if (!f->counted) {
+      f->res->counts = pool->count(f->fd);
+    }
+    uring_close_fd(b->ring, f->fd, i);
+  }
+  if (uring_run(b->ring, closed, b) == -1)
+    ring_broke();
+}
+
+// counts the n slots starting at the running counter first
+static void count_slots(struct file_pool *pool, struct batch *b, size_t first,
+                        size_t n) {
+  if (!b) {
+    count_one(pool, &pool->slots[first % pool->cap].res);
+    return;
+  }
+  struct file_result *res[URING_BATCH];
+  for (size_t i = 0; i < n; i++)
+    res[i] = &pool->slots[(first + i) % pool->cap].res;
+  count_batch(pool, b, res, n);
+}
+
+static void *worker(void *arg) {
+  struct file_pool *pool = arg;
+  struct batch *b = pool->batch > 1 ? batch_open() : NULL;
+
+  pthread_mutex_lock(&pool->lock);
+  while (true) {
+    while (!pool->closing && pool->claim == pool->tail)
+      pthread_cond_wait(&pool->work, &pool->lock);
+    if (pool->claim == pool->tail)
+      break; // closing and nothing left
+
+    // everything that's waiting, up to a batch
+    size_t first = pool->claim, n = pool->tail - pool->claim;
+    if (!b || n > pool->batch)
+      n = b ? pool->batch : 1;
+    pool->claim += n;
+    pthread_mutex_unlock(&pool->lock);
+
+    count_slots(pool, b, first, n);
+
+    pthread_mutex_lock(&pool->lock);
+    for (size_t i = 0; i < n; i++)
+      pool->slots[(first + i) % pool->cap].done = true;
+    pthread_cond_signal(&pool->done);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  batch_close(b);
+  return NULL;
+}
+
+struct file_pool *file_pool_start(long workers, struct wc (*count)(int fd),
+                                  bool batch) {
+  struct file_pool *pool = calloc(1, sizeof(*pool));
+  if (!pool)
+    goto oom;
+
+  if (workers < 2)
+    workers = 0;
+
+  // see if io_uring works at all, the workers set up their own rings
+  pool->batch = 1;
+  if (batch && (pool->local = batch_open())) {
+    pool->batch = URING_BATCH;
+    if (workers) {
+      batch_close(pool->local);
+      pool->local = NULL;
+    }
+  }
+
+  pool->cap = (workers ? workers * SLOTS_PER_WORKER : 1) * pool->batch;
+  pool->slots = calloc(pool->cap, sizeof(*pool->slots));
+  pool->tids = calloc(workers ? workers : 1, sizeof(*pool->tids));
+  if (!pool->slots || !pool->tids)
+    goto oom;
+
+  pool->count = count;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  for (long i = 0; i < workers; i++) {
+    if (pthread_create(&pool->tids[pool->nworkers], NULL, worker, pool) != 0)
+      break; // make do with what we got
+    pool->nworkers++;
+  }
+  return pool;
+
+oom:
+  fprintf(stderr, "wc: %s\n", strerror(errno));
+  exit(1);
+}
+
+bool file_pool_submit(struct file_pool *pool, char *name) {
+  pthread_mutex_lock(&pool->lock);
+  if (pool->tail - pool->head == pool->cap) {
+    pthread_mutex_unlock(&pool->lock);
+    return false;
+  }
+
+  struct slot *s = &pool->slots[pool->tail % pool->cap];
+  memset(s, 0, sizeof(*s));
+  s->res.name = name;
+  pool->tail++;
+  pthread_cond_signal(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+  return true;
+}
+
+bool file_pool_next(struct file_pool *pool, struct file_result *out) {
+  pthread_mutex_lock(&pool->lock);
+  if (pool->head == pool->tail) {
+    pthread_mutex_unlock(&pool->lock);
+    return false;
+  }
+
+  struct slot *s = &pool->slots[pool->head % pool->cap];
+  if (pool->nworkers == 0 && !s->done) {
+    // nobody to hand it to, just do it right here. with a ring that's
+    // everything submitted so far in one go
+    size_t first = pool->claim;
+    size_t n = pool->local ? pool->tail - pool->claim : 1;
+    pool->claim += n;
+    pthread_mutex_unlock(&pool->lock);
+    count_slots(pool, pool->local, first, n);
+    pthread_mutex_lock(&pool->lock);
+    for (size_t i = 0; i < n; i++)
+      pool->slots[(first + i) % pool->cap].done = true;
+  }
+  while (!s->done)
+    pthread_cond_wait(&pool->done, &pool->lock);
+
+  *out = s->res;
+  pool->head++;
+  pthread_mutex_unlock(&pool->lock);
+  return true;
+}
+
+void file_pool_finish(struct file_pool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->closing = true;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (long i = 0; i < pool->nworkers; i++)
+    pthread_join(pool->tids[i], NULL);
+
+  pthread_cond_destroy(&pool->done);
+  pthread_cond_destroy(&pool->work);
+  pthread_mutex_destroy(&pool->lock);
+  batch_close(pool->local);
+  free(pool->tids);
+  free(pool->slots);
+  free(pool);
+}
@@ -0,0 +1,51 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of coreutils from scratch.
+ * Copyright (c) 2025 Horstaufmental
+ *
+ * coreutils from scratch is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * coreutils from scratch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+#ifndef FILEPOOL_H
+#define FILEPOOL_H
+
+#include <stdbool.h>
+
+#include "count.h"
+
+/*
+a handful of worker threads that open and count files while the main thread
+is busy printing. names go in with file_pool_submit() and come back out of
+file_pool_next() in the exact same order, no matter which worker finished
+first. only a small window of files is ever in flight, so the memory use
+doesn't depend on how many names there are.
+*/
+struct file_pool;
+
+struct file_result {
+  char *name;       // whatever was submitted, handed back untouched
+  struct wc counts;
+  int err;          // errno if the file couldn't be opened, 0 otherwise
+};
+
+// workers < 2 means no threads at all, file_pool_next() does the work itself.
+// batch lets the pool open, stat and read small files itself, a few dozen at
+// a time through io_uring when the kernel has it. count() still gets
+// everything else, and everything when batch is false
+struct file_pool *file_pool_start(long workers, struct wc (*count)(int fd),
+                                  bool batch);
+// false when the window is full, take something out with file_pool_next()
+bool file_pool_submit(struct file_pool *pool, char *name);
+// false once everything submitted has been handed back
+bool file_pool_next(struct file_pool *pool, struct file_result *out);
+void file_pool_finish(struct file_pool *pool);
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of coreutils from scratch.
+ * Copyright (c) 2025 Horstaufmental
+ *
+ * coreutils from scratch is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * coreutils from scratch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "follow.h"
+
+struct followed {
+  int fd;
+  int wd; // inotify watch, -1 if we're just polling this one
+  struct wc_state state;
+  bool dirty;
+};
+
+static volatile sig_atomic_t stop = 0;
+
+static void on_signal(int sig) {
+  (void)sig;
+  stop = 1;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// pull in whatever got appended, false if nothing did
+static bool catch_up(struct followed *f, follow_count_fn count) {
+  struct stat st;
+  if (fstat(f->fd, &st) == -1)
+    return false;
+
+  if (S_ISREG(st.st_mode) && (size_t)st.st_size < f->state.counts.bytes) {
+    // truncated, start over
+    wc_state_init(&f->state);
+    lseek(f->fd, 0, SEEK_SET);
+  }
+
+  size_t before = f->state.counts.bytes;
+  count(f->fd, &f->state);
+  return f->state.counts.bytes != before;
+}
+
+int follow_files(char *const names[], int n, double interval,
+                 follow_count_fn count, follow_report_fn report) {
+  struct followed *files = calloc(n, sizeof(*files));
+  struct wc *counts = calloc(n, sizeof(*counts));
+  if (!files || !counts) {
+    fprintf(stderr, "wc: %s\n", strerror(errno));
+    exit(1);
+  }
+
+  // without inotify we just look at everything every interval
+  int ino = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+  for (int i = 0; i < n; i++) {
+    files[i].fd = open(names[i], O_RDONLY | O_CLOEXEC);
+    if (files[i].fd == -1) {
+      fprintf(stderr, "wc: %s: %s\n", names[i], strerror(errno));
+      return 1;
+    }
+    files[i].wd = ino == -1 ? -1
+                            : inotify_add_watch(ino, names[i],
+                                                IN_MODIFY | IN_ATTRIB);
+    wc_state_init(&files[i].state);
+    files[i].dirty = true;
+  }
+
+  struct sigaction sa = {.sa_handler = on_signal};
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  double next = now();
+  bool first = true;
+  while (!stop) {
+    double wait = next - now();
+    if (wait > 0) {
+      struct pollfd pfd = {.fd = ino, .events = POLLIN};
+      // a long enough interval doesn't fit in poll()'s int, it just wakes up
+      // early and goes back to sleep
+      double ms = wait * 1000 + 1;
+      int r = poll(&pfd, ino == -1 ? 0 : 1, ms < INT_MAX ? (int)ms : INT_MAX);
+      if (r == -1 && errno != EINTR)
+        break;
+      if (r > 0) {
+        // the watch descriptors say which ones, the events themselves
+        // don't matter
+        char buf[4096]
+            __attribute__((aligned(__alignof__(struct inotify_event))));
+        ssize_t len;
+        while ((len = read(ino, buf, sizeof(buf))) > 0) {
+          for (char *p = buf; p < buf + len;) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            for (int i = 0; i < n; i++)
+              if (files[i].wd == ev->wd)
+                files[i].dirty = true;
+            p += sizeof(*ev) + ev->len;
+          }
+        }
+      }
+      if (now() < next)
+        continue;
+    }
+    next += interval;
+    if (next < now())
+      next = now() + interval; // fell behind, don't try to make up for it
+
+    bool changed = first;
+    for (int i = 0; i < n; i++) {
+      if (files[i].wd != -1 && !files[i].dirty)
+        continue;
+      files[i].dirty = false;
+      changed |= catch_up(&files[i], count);
+    }
+    first = false;
+    if (!changed)
+      continue;
+
+    // finishing touches the state, the real one has to keep going
+    for (int i = 0; i < n; i++) {
+      struct wc_state snap = files[i].state;
+      counts[i] = wc_state_finish(&snap);
+    }
+    report(names, counts, n);
+  }
+
+  for (int i = 0; i < n; i++)
+    close(files[i].fd);
+  if (ino != -1)
+    close(ino);
+  free(counts);
+  free(files);
+  return 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of coreutils from scratch.
+ * Copyright (c) 2025 Horstaufmental
+ *
+ * coreutils from scratch is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * coreutils from scratch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+#ifndef FOLLOW_H
+#define FOLLOW_H
+
+#include "count.h"
+
+/*
+wc --follow: the files stay open and every one keeps its wc_state around, so
+when something gets appended only the new bytes go through the scanner.
+inotify says when to look, every interval seconds whatever changed gets
+counted and handed to report(). runs until SIGINT/SIGTERM.
+
+like tail -f (not -F) it sticks with the file it opened, a log that gets
+rotated away just stops growing. one that gets truncated is counted again
+from the start.
+*/
+
+// reads fd from where it is to EOF, into state
+typedef void (*follow_count_fn)(int fd, struct wc_state *state);
+// the current counts of all n files, in the order they were named
+typedef void (*follow_report_fn)(char *const names[], const struct wc counts[],
+                                 int n);
+
+// 0 once interrupted, 1 if a file couldn't be opened
+int follow_files(char *const names[], int n, double interval,
+                 follow_count_fn count, follow_report_fn report);
+
+#endif
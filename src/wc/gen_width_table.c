@@ -0,0 +1,173 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of coreutils from scratch.
+ * Copyright (c) 2025 Horstaufmental
+ *
+ * coreutils from scratch is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * coreutils from scratch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <langinfo.h>
+#include <locale.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <wctype.h>
+
+/*
+build time helper for wc. asks libc, once for every unicode codepoint, the same
+questions wc's utf-8 lane used to ask per character (iswprint, wcwidth,
+iswspace) and writes the answers out as a two stage lookup table:
+
+  stage1[cp >> SHIFT] picks a block, stage2[block][cp & MASK] is the class
+
+most blocks are identical (unassigned planes, cjk, ...) so they only get stored
+once. if the build machine has no utf-8 locale at all we write an empty table
+and wc keeps calling libc at runtime.
+*/
+
+#define MAX_CP 0x110000
+#define SHIFT 7
+#define BLOCK_SZ (1 << SHIFT)
+#define NBLOCKS (MAX_CP >> SHIFT)
+
+#define CLASS_WIDTH 0x3 // display width, 0-2
+#define CLASS_SPACE 0x4 // ends a word
+
+static const char *utf8_locales[] = {"C.UTF-8", "C.utf8", "en_US.UTF-8",
+                                     "en_US.utf8", NULL};
+
+static bool is_word_seperator(wchar_t wc) {
+  if (iswspace(wc))
+    return true;
+
+  switch (wc) {
+  case 0x00A0:
+  case 0x2007:
+  case 0x202F:
+  case 0x2060:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static unsigned char classify(wchar_t wc) {
+  unsigned char cls = 0;
+  if (iswprint(wc)) {
+    int width = wcwidth(wc);
+    if (width > 0)
+      cls |= width & CLASS_WIDTH;
+  }
+  if (is_word_seperator(wc))
+    cls |= CLASS_SPACE;
+  return cls;
+}
+
+static void write_header(FILE *out) {
+  fputs("/* generated by gen_width_table.c, do not edit */\n"
+        "#ifndef WC_WIDTH_TABLE_H\n"
+        "#define WC_WIDTH_TABLE_H\n\n"
+        "#include <stdint.h>\n\n",
+        out);
+  fprintf(out,
+          "#define WC_CLASS_WIDTH 0x%x\n"
+          "#define WC_CLASS_SPACE 0x%x\n\n",
+          CLASS_WIDTH, CLASS_SPACE);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s OUTPUT\n", argv[0]);
+    return 1;
+  }
+
+  FILE *out = fopen(argv[1], "w");
+  if (!out) {
+    fprintf(stderr, "%s: %s: %s\n", argv[0], argv[1], strerror(errno));
+    return 1;
+  }
+  write_header(out);
+
+  const char *loc = NULL;
+  for (int i = 0; utf8_locales[i]; i++) {
+    if (setlocale(LC_CTYPE, utf8_locales[i]) &&
+        strcmp(nl_langinfo(CODESET), "UTF-8") == 0) {
+      loc = utf8_locales[i];
+      break;
+    }
+  }
+
+  if (!loc) {
+    fprintf(stderr, "%s: no utf-8 locale found, wc will ask libc at runtime\n",
+            argv[0]);
+    fputs("#define WC_HAVE_WIDTH_TABLE 0\n\n#endif\n", out);
+    fclose(out);
+    return 0;
+  }
+
+  static unsigned char cls[MAX_CP];
+  for (uint32_t cp = 0; cp < MAX_CP; cp++)
+    cls[cp] = classify((wchar_t)cp);
+
+  // dedupe the blocks
+  static uint16_t stage1[NBLOCKS];
+  static uint32_t uniq[NBLOCKS]; // first block with this content
+  size_t nuniq = 0;
+  for (size_t b = 0; b < NBLOCKS; b++) {
+    size_t u;
+    for (u = 0; u < nuniq; u++) {
+      if (memcmp(cls + (size_t)uniq[u] * BLOCK_SZ, cls + b * BLOCK_SZ,
+                 BLOCK_SZ) == 0)
+        break;
+    }
+    if (u == nuniq)
+      uniq[nuniq++] = b;
+    stage1[b] = u;
+  }
+
+  const char *idx_type = nuniq <= 256 ? "uint8_t" : "uint16_t";
+
+  fprintf(out,
+          "// built from the %s locale, %zu unique blocks of %d\n"
+          "#define WC_HAVE_WIDTH_TABLE 1\n"
+          "#define WC_TABLE_MAX_CP 0x%x\n"
+          "#define WC_TABLE_SHIFT %d\n"
+          "#define WC_TABLE_MASK 0x%x\n\n",
+          loc, nuniq, BLOCK_SZ, MAX_CP, SHIFT, BLOCK_SZ - 1);
+
+  fprintf(out, "static const %s wc_table_stage1[%d] = {", idx_type, NBLOCKS);
+  for (size_t b = 0; b < NBLOCKS; b++)
+    fprintf(out, "%s%u,", b % 16 ? " " : "\n  ", stage1[b]);
+  fputs("\n};\n\n", out);
+
+  fprintf(out, "static const uint8_t wc_table_stage2[%zu][%d] = {\n", nuniq,
+          BLOCK_SZ);
+  for (size_t u = 0; u < nuniq; u++) {
+    const unsigned char *blk = cls + (size_t)uniq[u] * BLOCK_SZ;
+    fputs("  {", out);
+    for (int j = 0; j < BLOCK_SZ; j++)
+      fprintf(out, "%s%u,", j % 32 ? "" : "\n    ", blk[j]);
+    fputs("\n  },\n", out);
+  }
+  fputs("};\n\n#endif\n", out);
+
+  if (fclose(out) != 0) {
+    fprintf(stderr, "%s: %s: %s\n", argv[0], argv[1], strerror(errno));
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of coreutils from scratch.
+ * Copyright (c) 2025 Horstaufmental
+ *
+ * coreutils from scratch is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * coreutils from scratch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "output.h"
+
+#define OUTBUF_SIZE (64 * 1024)
+// a size_t is 20 digits at most, leave room for silly widths too
+#define NUM_MAX 64
+
+static char outbuf[OUTBUF_SIZE];
+static size_t outlen;
+
+static const char digit_pairs[201] = "00010203040506070809"
+                                     "10111213141516171819"
+                                     "20212223242526272829"
+                                     "30313233343536373839"
+                                     "40414243444546474849"
+                                     "50515253545556575859"
+                                     "60616263646566676869"
+                                     "70717273747576777879"
+                                     "80818283848586878889"
+                                     "90919293949596979899";
+
+int out_num_width(size_t v) {
+  int width = 1;
+  while (v >= 10000) {
+    v /= 10000;
+    width += 4;
+  }
+  if (v >= 1000)
+    return width + 3;
+  if (v >= 100)
+    return width + 2;
+  if (v >= 10)
+    return width + 1;
+  return width;
+}
+
+void out_flush(void) {
+  size_t off = 0;
+  while (off < outlen) {
+    ssize_t n = write(STDOUT_FILENO, outbuf + off, outlen - off);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      fprintf(stderr, "wc: write error: %s\n", strerror(errno));
+      _exit(1); // might be running from atexit(), exit() isn't allowed there
+    }
+    off += n;
+  }
+  outlen = 0;
+}
+
+void out_str(const char *s, size_t len) {
+  while (len) {
+    if (outlen == OUTBUF_SIZE)
+      out_flush();
+    size_t n = OUTBUF_SIZE - outlen;
+    if (n > len)
+      n = len;
+    memcpy(outbuf + outlen, s, n);
+    outlen += n;
+    s += n;
+    len -= n;
+  }
+}
+
+void out_char(char c) {
+  if (outlen == OUTBUF_SIZE)
+    out_flush();
+  outbuf[outlen++] = c;
+}
+
+void out_num(size_t v, int width) {
+  if (width > NUM_MAX)
+    width = NUM_MAX;
+  if (OUTBUF_SIZE - outlen < NUM_MAX)
+    out_flush();
+
+  // two digits at a time, back to front
+  char tmp[NUM_MAX];
+  char *p = tmp + sizeof(tmp);
+  while (v >= 100) {
+    const char *d = digit_pairs + (v % 100) * 2;
+    v /= 100;
+    *--p = d[1];
+    *--p = d[0];
+  }
+  if (v >= 10) {
+    *--p = digit_pairs[v * 2 + 1];
+    *--p = digit_pairs[v * 2];
+  } else {
+    *--p = '0' + v;
+  }
+
+  int len = tmp + sizeof(tmp) - p;
+  char *out = outbuf + outlen;
+  if (width > len) {
+    memset(out, ' ', width - len);
+    out += width - len;
+  }
+  memcpy(out, p, len);
+  outlen = out + len - outbuf;
+}
@@ -0,0 +1,37 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of coreutils from scratch.
+ * Copyright (c) 2025 Horstaufmental
+ *
+ * coreutils from scratch is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * coreutils from scratch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+
+/*
+everything wc prints to stdout goes through here. rows get built in one big
+buffer that goes out with a single write() whenever it fills up (and at exit),
+instead of half a dozen printf()s and a stdio line flush per file.
+*/
+
+// how many characters v takes up in decimal
+int out_num_width(size_t v);
+// v right aligned in a field of width characters
+void out_num(size_t v, int width);
+void out_str(const char *s, size_t len);
+void out_char(char c);
+// push whatever is buffered out, exits on a write error
+void out_flush(void);
+
+#endif
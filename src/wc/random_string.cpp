@@ -1,94 +1,307 @@
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
-#include <fstream>
-#include <random>
-#include <string>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
 #include <iostream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// usage: random_string [OPTION]... [DIR]
+//
+// writes the test corpora for wc/cat. the output only depends on the seed and
+// the options, never on the thread count: the file is cut into fixed size
+// chunks, every chunk gets its own generator seeded from (seed, file, chunk)
+// and is written straight to its own offset, so it doesn't matter which
+// thread does which chunk or in what order they finish.
+
+static const size_t CHUNK = 4 << 20;
+
+struct range {
+  uint64_t lo, hi;
+};
+
+struct options {
+  uint64_t seed = 0;
+  uint64_t size = 150000000;
+  unsigned threads = 0;
+  range line = {0, 200}; // characters per line
+  range word = {1, 12};  // characters per word
+  unsigned tabs = 10;    // percent of word separators that are tabs
+  range cp = {0x80, 0x10FFFF};
+};
+
+// splitmix64, only used to turn (seed, file, chunk) into generator state
+static uint64_t splitmix(uint64_t &x) {
+  uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+// xoshiro256**, hand rolled so the data is the same with every standard
+// library, std::uniform_int_distribution doesn't promise that
+struct rng {
+  uint64_t s[4];
+
+  rng(uint64_t seed, uint64_t file, uint64_t chunk) {
+    uint64_t x = seed ^ (file * 0xD1B54A32D192ED03ULL) ^
+                 (chunk * 0x8CB92BA72F3D8DD7ULL);
+    for (auto &v : s)
+      v = splitmix(x);
+  }
+
+  static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
 
-std::string to_utf8(char32_t codepoint) {
-  std::string utf8_char;
+  uint64_t next() {
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+  }
+
+  // lo..hi inclusive
+  uint64_t between(range r) {
+    uint64_t span = r.hi - r.lo + 1;
+    if (span == 0)
+      return next();
+    return r.lo + next() % span; // the bias is way below anything we'd notice
+  }
+
+  bool percent(unsigned pct) { return between({0, 99}) < pct; }
+};
+
+static size_t to_utf8(char32_t codepoint, char *out) {
   if (codepoint < 0x80) {
-    utf8_char += static_cast<char>(codepoint);
+    out[0] = static_cast<char>(codepoint);
+    return 1;
   } else if (codepoint < 0x800) {
-    utf8_char += static_cast<char>(0xC0 | (codepoint >> 6));
-    utf8_char += static_cast<char>(0x80 | (codepoint & 0x3F));
+    out[0] = static_cast<char>(0xC0 | (codepoint >> 6));
+    out[1] = static_cast<char>(0x80 | (codepoint & 0x3F));
+    return 2;
   } else if (codepoint < 0x10000) {
-    utf8_char += static_cast<char>(0xE0 | (codepoint >> 12));
-    utf8_char += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
-    utf8_char += static_cast<char>(0x80 | (codepoint & 0x3F));
-  } else if (codepoint < 0x110000) {
-    utf8_char += static_cast<char>(0xF0 | (codepoint >> 18));
-    utf8_char += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
-    utf8_char += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
-    utf8_char += static_cast<char>(0x80 | (codepoint & 0x3F));
+    out[0] = static_cast<char>(0xE0 | (codepoint >> 12));
+    out[1] = static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+    out[2] = static_cast<char>(0x80 | (codepoint & 0x3F));
+    return 3;
   }
-  return utf8_char;
+  out[0] = static_cast<char>(0xF0 | (codepoint >> 18));
+  out[1] = static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+  out[2] = static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+  out[3] = static_cast<char>(0x80 | (codepoint & 0x3F));
+  return 4;
 }
 
-std::string generate_random_utf8_string(int length) {
-  std::random_device rd;
-  std::mt19937 gen(rd());
-  std::uniform_int_distribution<char32_t> distrib(
-      0x0020, 0x10FFFF); // Example range: printable ASCII to max Unicode
-
-  std::string random_string;
-  for (int i = 0; i < length; ++i) {
-    char32_t codepoint = distrib(gen);
-    if ((codepoint >= 0xD800 && codepoint <= 0xDFFF) || // Surrogates
-        (codepoint >= 0xFDD0 && codepoint <= 0xFDEF) || // Noncharacters
-        (codepoint >= 0xFFFE && codepoint <= 0xFFFF)) { // Noncharacters
-      // Skip invalid or non-printable code points, or re-generate
-      --i; // Decrement i to generate another character for this position
+static bool valid_codepoint(uint64_t codepoint) {
+  return codepoint <= 0x10FFFF &&
+         !(codepoint >= 0xD800 && codepoint <= 0xDFFF) && // Surrogates
+         !(codepoint >= 0xFDD0 && codepoint <= 0xFDEF) && // Noncharacters
+         (codepoint & 0xFFFE) != 0xFFFE;                  // Noncharacters
+}
+
+static const char ascii_chars[] =
+    "abcdefghijklmnopqrstuvwxyz1234567890@#$_&-+()/*':;!?~`^={}\\\"%[]";
+
+// one chunk worth of text, exactly len bytes. every chunk starts a new line
+static void generate_chunk(const options &opt, rng &gen, unsigned utf8_pct,
+                           char *buf, size_t len) {
+  size_t pos = 0;
+  uint64_t line_left = gen.between(opt.line);
+  uint64_t word_left = gen.between(opt.word);
+
+  while (pos < len) {
+    if (line_left == 0) {
+      buf[pos++] = '\n';
+      line_left = gen.between(opt.line);
+      word_left = gen.between(opt.word);
+      continue;
+    }
+    line_left--;
+
+    if (word_left == 0) {
+      buf[pos++] = gen.percent(opt.tabs) ? '\t' : ' ';
+      word_left = gen.between(opt.word);
       continue;
     }
-    random_string += to_utf8(codepoint);
+    word_left--;
+
+    if (utf8_pct && gen.percent(utf8_pct)) {
+      uint64_t codepoint;
+      do
+        codepoint = gen.between(opt.cp);
+      while (!valid_codepoint(codepoint));
+
+      char tmp[4];
+      size_t n = to_utf8(static_cast<char32_t>(codepoint), tmp);
+      if (n <= len - pos) {
+        std::memcpy(buf + pos, tmp, n);
+        pos += n;
+        continue;
+      }
+      // doesn't fit at the end of the chunk, pad with ascii instead
+    }
+    buf[pos++] = ascii_chars[gen.between({0, sizeof(ascii_chars) - 2})];
   }
-  return random_string;
 }
 
-std::string generate_random_str(size_t length) {
-  const std::string chars =
-      "abcdefghijklmnopqrstuvwxyz1234567890@#$_&-+()/*':;!?~`^={}\\\"%[]\n\t";
-  std::random_device rd;
-  std::mt19937 generator(rd());
-  std::uniform_int_distribution<size_t> distribution(0, chars.length() - 1);
+static bool write_file(const options &opt, const std::string &path,
+                       uint64_t file, unsigned utf8_pct) {
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1 || ftruncate(fd, opt.size) == -1) {
+    std::perror(path.c_str());
+    if (fd != -1)
+      close(fd);
+    return false;
+  }
+
+  uint64_t nchunks = (opt.size + CHUNK - 1) / CHUNK;
+  unsigned nthreads = opt.threads;
+  if (nthreads > nchunks)
+    nthreads = nchunks ? nchunks : 1;
+
+  std::atomic<bool> ok(true);
+  auto work = [&](unsigned id) {
+    std::vector<char> buf(CHUNK);
+    for (uint64_t k = id; k < nchunks; k += nthreads) {
+      size_t len = std::min<uint64_t>(CHUNK, opt.size - k * CHUNK);
+      rng gen(opt.seed, file, k);
+      generate_chunk(opt, gen, utf8_pct, buf.data(), len);
+
+      size_t done = 0;
+      while (done < len) {
+        ssize_t n = pwrite(fd, buf.data() + done, len - done, k * CHUNK + done);
+        if (n <= 0) {
+          ok = false;
+          return;
+        }
+        done += n;
+      }
+    }
+  };
 
-  std::string random_str;
-  random_str.reserve(length);
+  std::vector<std::thread> threads;
+  for (unsigned i = 1; i < nthreads; i++)
+    threads.emplace_back(work, i);
+  work(0);
+  for (auto &t : threads)
+    t.join();
 
-  for (size_t i = 0; i < length; i++) {
-    random_str += chars[distribution(generator)];
+  if (close(fd) != 0 || !ok) {
+    std::perror(path.c_str());
+    return false;
   }
+  return true;
+}
 
-  return random_str;
+static bool parse_size(const char *s, uint64_t &out) {
+  char *end;
+  out = std::strtoull(s, &end, 10);
+  if (end == s)
+    return false;
+  switch (*end) {
+  case 'K': out <<= 10; end++; break;
+  case 'M': out <<= 20; end++; break;
+  case 'G': out <<= 30; end++; break;
+  }
+  return *end == '\0';
 }
 
-int main(void) {
-  std::ofstream output("tests/ascii.txt");
-  std::ofstream output_utf8("tests/utf8.txt");
-  std::ofstream output_utf8_ascii("tests/utf8-ascii-mix.txt");
+// MIN or MIN:MAX
+static bool parse_range(const char *s, range &out, int base) {
+  char *end;
+  out.lo = std::strtoull(s, &end, base);
+  if (end == s)
+    return false;
+  out.hi = out.lo;
+  if (*end == ':') {
+    const char *hi = end + 1;
+    out.hi = std::strtoull(hi, &end, base);
+    if (end == hi)
+      return false;
+  }
+  return *end == '\0' && out.lo <= out.hi;
+}
 
-  if (output.is_open()) {
-    output << generate_random_str(150000000) << std::endl;
-    output.close();
-    std::cout << "Generated ASCII string of 150 million characters." << std::endl;
-  } else {
-    return 1;
+static void usage(const char *prog) {
+  std::cerr
+      << "Usage: " << prog << " [OPTION]... [DIR]\n"
+      << "Write ascii.txt, utf8.txt and utf8-ascii-mix.txt into DIR (default: tests).\n\n"
+      << "  -s SEED        seed, same seed same files (default: 0)\n"
+      << "  -n SIZE        bytes per file, K/M/G suffixes work (default: 150000000)\n"
+      << "  -j THREADS     generator threads, doesn't change the output\n"
+      << "  -l MIN[:MAX]   characters per line (default: 0:200)\n"
+      << "  -w MIN[:MAX]   characters per word (default: 1:12)\n"
+      << "  -t PCT         percent of word separators that are tabs (default: 10)\n"
+      << "  -u LO[:HI]     non-ascii code points, in hex (default: 80:10FFFF)\n";
+}
+
+int main(int argc, char *argv[]) {
+  options opt;
+  uint64_t n;
+  int c;
+  while ((c = getopt(argc, argv, "s:n:j:l:w:t:u:h")) != -1) {
+    bool ok = true;
+    switch (c) {
+    case 's': opt.seed = std::strtoull(optarg, nullptr, 10); break;
+    case 'n': ok = parse_size(optarg, opt.size); break;
+    case 'j':
+      ok = parse_size(optarg, n) && n > 0 && n < 4096;
+      opt.threads = n;
+      break;
+    case 'l': ok = parse_range(optarg, opt.line, 10); break;
+    case 'w': ok = parse_range(optarg, opt.word, 10); break;
+    case 't':
+      ok = parse_size(optarg, n) && n <= 100;
+      opt.tabs = n;
+      break;
+    case 'u':
+      ok = parse_range(optarg, opt.cp, 16) && opt.cp.hi <= 0x10FFFF;
+      break;
+    case 'h': usage(argv[0]); return 0;
+    default: ok = false; break;
+    }
+    if (!ok) {
+      usage(argv[0]);
+      return 1;
+    }
   }
 
-  if (output_utf8.is_open()) {
-    output_utf8 << generate_random_utf8_string(150000000) << std::endl;
-    output_utf8.close();
-    std::cout << "Generated UTF-8 string of 150 million characters." << std::endl;
-  } else {
+  // there has to be something in there we're allowed to pick
+  bool any = false;
+  for (uint64_t cp = opt.cp.lo; cp <= opt.cp.hi && !any; cp++)
+    any = valid_codepoint(cp);
+  if (!any) {
+    std::cerr << argv[0] << ": no usable code points in that range\n";
     return 1;
   }
 
-  if (output_utf8_ascii.is_open()) {
-    output_utf8_ascii << generate_random_str(75000000) << generate_random_utf8_string(75000000) << std::endl;
-    output_utf8_ascii.close();
-    std::cout << "Generated UTF-8 and ASCII mixed string of 150 million characters." << std::endl;
-  } else {
-    return 1;
+  if (opt.threads == 0)
+    opt.threads = std::thread::hardware_concurrency();
+  if (opt.threads == 0)
+    opt.threads = 1;
+
+  std::string dir = optind < argc ? argv[optind] : "tests";
+
+  struct {
+    const char *name;
+    unsigned utf8_pct;
+  } files[] = {{"ascii.txt", 0}, {"utf8.txt", 100}, {"utf8-ascii-mix.txt", 50}};
+
+  for (uint64_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+    if (!write_file(opt, dir + "/" + files[i].name, i, files[i].utf8_pct))
+      return 1;
+    std::cout << "Generated " << files[i].name << ", " << opt.size << " bytes."
+              << std::endl;
   }
   return 0;
 }
@@ -26,7 +26,7 @@ fi
 
 if [ ! -f "tests/random_string" ]; then
     echo "Compiling random_string generator..."
-    g++ -O3 -march=native -pipe -flto -DNDEBUG -pedantic -o tests/random_string random_string.cpp && strip tests/random_string
+    g++ -O3 -march=native -pipe -flto -DNDEBUG -pedantic -pthread -o tests/random_string random_string.cpp && strip tests/random_string
     if [ $? -ne 0 ]; then
         echo "Failed to compile random_string generator."
         exit 1
@@ -40,8 +40,16 @@ if [ $? -ne 0 ]; then
     exit 1
 fi
 
-printf "Compiling wc..."
-gcc -O3 -march=native -pipe -flto -DNDEBUG -pedantic -o wc wc.c
+printf "Generating width table..."
+gcc -O2 -o tests/gen_width_table gen_width_table.c && tests/gen_width_table tests/wc_width_table.h
+if [ $? -ne 0 ]; then
+    echo "Failed to generate width table."
+    exit 1
+fi
+
+printf "\rCompiling wc...           "
+# same flags as the CMake build, so this tests what actually gets built
+gcc -std=gnu99 -Wall -Wextra -Werror -pedantic -O2 -DNDEBUG -flto -Itests -o wc wc.c count.c filepool.c output.c cache.c follow.c uring.c -pthread
 if [ $? -ne 0 ]; then
     echo "Failed to compile wc."
     exit 1
@@ -68,6 +76,33 @@ if [ $? -ne 0 ]; then
     exit 1
 fi
 
+echo "Testing wc -c on a stdin that's already been read from..."
+printf '0123456789abcdef' > tests/offset.txt
+got=$({ head -c 6 >/dev/null; ./wc -c; } < tests/offset.txt | tr -d " ")
+rm -f tests/offset.txt
+if [ "$got" != "10" ]; then
+    echo "wc -c counted from the start of the file: '$got', should be '10'."
+    exit 1
+fi
+
+echo "Testing wc --cache with a file rewritten in the middle at the same size..."
+cp tests/ascii.txt tests/cache_rewrite.txt
+rm -f tests/wc.cache
+./wc --cache=tests/wc.cache -lwmL tests/cache_rewrite.txt > /dev/null
+printf 'appended line\n' >> tests/cache_rewrite.txt
+./wc --cache=tests/wc.cache -lwmL tests/cache_rewrite.txt > /dev/null
+size=$(stat -c %s tests/cache_rewrite.txt)
+head -c 5000 /dev/zero | tr '\0' '\n' |
+    dd of=tests/cache_rewrite.txt bs=1 seek=$((size / 2)) conv=notrunc status=none
+touch tests/cache_rewrite.txt
+cached=$(./wc --cache=tests/wc.cache -lwmL tests/cache_rewrite.txt)
+fresh=$(./wc -lwmL tests/cache_rewrite.txt)
+rm -f tests/cache_rewrite.txt tests/wc.cache
+if [ "$cached" != "$fresh" ]; then
+    echo "wc --cache gave stale counts: '$cached', should be '$fresh'."
+    exit 1
+fi
+
 echo -e "\nRunning benchmark on GNU's wc..."
 time wc -cmlLw --total=always --files0-from=tests/file_list.txt
 if [ $? -ne 0 ]; then
@@ -0,0 +1,244 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of coreutils from scratch.
+ * Copyright (c) 2025 Horstaufmental
+ *
+ * coreutils from scratch is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * coreutils from scratch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "uring.h"
+
+struct uring {
+  int fd;
+  unsigned entries;
+  unsigned queued; // sqes filled in since the last uring_run()
+
+  // the kernel reads tail and writes head of the submission ring, and the
+  // other way around for the completion ring
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  struct io_uring_sqe *sqes;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_cqe *cqes;
+
+  void *sq_map, *cq_map;
+  size_t sq_len, cq_len, sqes_len;
+};
+
+static int sys_setup(unsigned entries, struct io_uring_params *p) {
+  return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned submit, unsigned wait, unsigned flags) {
+  return syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+static int sys_register(int fd, unsigned op, void *arg, unsigned n) {
+  return syscall(__NR_io_uring_register, fd, op, arg, n);
+}
+
+// openat/statx/read/close all showed up in 5.6, same as the probe, so a
+// kernel that can't answer the probe can't do the rest either
+static bool has_ops(int fd) {
+  static const unsigned char ops[] = {IORING_OP_OPENAT, IORING_OP_STATX,
+                                      IORING_OP_READ, IORING_OP_CLOSE};
+  size_t len = sizeof(struct io_uring_probe) +
+               256 * sizeof(struct io_uring_probe_op);
+  struct io_uring_probe *probe = calloc(1, len);
+  if (!probe)
+    return false;
+
+  bool ok = sys_register(fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+  for (size_t i = 0; ok && i < sizeof(ops); i++)
+    ok = ops[i] <= probe->last_op &&
+         (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+  free(probe);
+  return ok;
+}
+
+struct uring *uring_open(unsigned entries) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  // completions get run when we ask for them instead of interrupting us,
+  // noticeably cheaper. 6.1 and up, and the ring can't leave its thread
+  p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+  int fd = sys_setup(entries, &p);
+  if (fd == -1 && errno == EINVAL) {
+    memset(&p, 0, sizeof(p));
+    fd = sys_setup(entries, &p);
+  }
+  if (fd == -1)
+    return NULL; // ENOSYS, EPERM from io_uring_disabled, seccomp...
+
+  struct uring *ring = calloc(1, sizeof(*ring));
+  if (!ring || !has_ops(fd)) {
+    free(ring);
+    close(fd);
+    return NULL;
+  }
+  ring->fd = fd;
+  ring->entries = p.sq_entries;
+
+  ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+  if (single) {
+    if (ring->cq_len > ring->sq_len)
+      ring->sq_len = ring->cq_len;
+    ring->cq_len = ring->sq_len;
+  }
+
+  ring->sq_map = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (ring->sq_map == MAP_FAILED)
+    goto fail_sq;
+  ring->cq_map = single ? ring->sq_map
+                        : mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, fd,
+                               IORING_OFF_CQ_RING);
+  if (ring->cq_map == MAP_FAILED)
+    goto fail_cq;
+  ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED)
+    goto fail_sqes;
+
+  char *sq = ring->sq_map, *cq = ring->cq_map;
+  ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+  ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+  ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+  ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+  ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  return ring;
+
+fail_sqes:
+  if (!single)
+    munmap(ring->cq_map, ring->cq_len);
+fail_cq:
+  munmap(ring->sq_map, ring->sq_len);
+fail_sq:
+  close(fd);
+  free(ring);
+  return NULL;
+}
+
+void uring_close(struct uring *ring) {
+  munmap(ring->sqes, ring->sqes_len);
+  if (ring->cq_map != ring->sq_map)
+    munmap(ring->cq_map, ring->cq_len);
+  munmap(ring->sq_map, ring->sq_len);
+  close(ring->fd);
+  free(ring);
+}
+
+// copies sqe into the next free slot and makes it visible to the kernel
+static bool queue(struct uring *ring, const struct io_uring_sqe *sqe) {
+  unsigned tail = *ring->sq_tail;
+  if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->entries)
+    return false;
+
+  unsigned idx = tail & *ring->sq_mask;
+  ring->sqes[idx] = *sqe;
+  ring->sq_array[idx] = idx;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ring->queued++;
+  return true;
+}
+
+bool uring_openat(struct uring *ring, const char *path, int flags,
+                  uint64_t data) {
+  struct io_uring_sqe sqe = {
+      .opcode = IORING_OP_OPENAT,
+      .fd = AT_FDCWD,
+      .addr = (uintptr_t)path,
+      .open_flags = flags,
+      .user_data = data,
+  };
+  return queue(ring, &sqe);
+}
+
+bool uring_statx(struct uring *ring, int fd, struct statx *stx, uint64_t data) {
+  struct io_uring_sqe sqe = {
+      .opcode = IORING_OP_STATX,
+      .fd = fd,
+      .addr = (uintptr_t)"",
+      .len = STATX_TYPE | STATX_SIZE,
+      .off = (uintptr_t)stx,
+      .statx_flags = AT_EMPTY_PATH,
+      .user_data = data,
+  };
+  return queue(ring, &sqe);
+}
+
+bool uring_read(struct uring *ring, int fd, void *buf, unsigned len,
+                uint64_t off, uint64_t data) {
+  struct io_uring_sqe sqe = {
+      .opcode = IORING_OP_READ,
+      .fd = fd,
+      .addr = (uintptr_t)buf,
+      .len = len,
+      .off = off,
+      .user_data = data,
+  };
+  return queue(ring, &sqe);
+}
+
+bool uring_close_fd(struct uring *ring, int fd, uint64_t data) {
+  struct io_uring_sqe sqe = {
+      .opcode = IORING_OP_CLOSE,
+      .fd = fd,
+      .user_data = data,
+  };
+  return queue(ring, &sqe);
+}
+
+int uring_run(struct uring *ring,
+              void (*done)(void *arg, uint64_t data, int res), void *arg) {
+  unsigned submit = ring->queued, left = ring->queued;
+  ring->queued = 0;
+
+  while (left > 0) {
+    int ret = sys_enter(ring->fd, submit, left, IORING_ENTER_GETEVENTS);
+    if (ret == -1) {
+      // nothing got submitted this time around, the kernel wants us to try
+      // again (or we caught a signal while waiting)
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+        continue;
+      return -1;
+    }
+    if (submit)
+      submit -= ret;
+
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail && left > 0; head++, left--) {
+      struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+      done(arg, cqe->user_data, cqe->res);
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+  }
+  return 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of coreutils from scratch.
+ * Copyright (c) 2025 Horstaufmental
+ *
+ * coreutils from scratch is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * coreutils from scratch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ */
+#ifndef URING_H
+#define URING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+the bare minimum of io_uring, talked to through the raw syscalls so there's
+nothing to link against. queue up to `entries` operations, then uring_run()
+submits all of them in one io_uring_enter() and waits until every one of them
+is back. `data` is whatever the caller wants to get handed back with the
+result, which is what the syscall would have returned or -errno. a ring
+belongs to the thread that opened it.
+*/
+struct uring;
+struct statx; // sys/stat.h only has it with _GNU_SOURCE
+
+// NULL if the kernel doesn't have io_uring, has it turned off, or is missing
+// any of the operations below
+struct uring *uring_open(unsigned entries);
+void uring_close(struct uring *ring);
+
+// false once the queue is full
+bool uring_openat(struct uring *ring, const char *path, int flags,
+                  uint64_t data);
+bool uring_statx(struct uring *ring, int fd, struct statx *stx, uint64_t data);
+bool uring_read(struct uring *ring, int fd, void *buf, unsigned len,
+                uint64_t off, uint64_t data);
+bool uring_close_fd(struct uring *ring, int fd, uint64_t data);
+
+// -1 and errno if the ring itself broke
+int uring_run(struct uring *ring,
+              void (*done)(void *arg, uint64_t data, int res), void *arg);
+
+#endif
@@ -19,7 +19,11 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <locale.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -29,8 +33,12 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
-#include <wchar.h>
-#include <wctype.h>
+
+#include "cache.h"
+#include "count.h"
+#include "filepool.h"
+#include "follow.h"
+#include "output.h"
 
 #define P_BYTES (1 << 0)
 #define P_CHARS (1 << 1)
@@ -38,6 +46,8 @@
 #define P_LENMX (1 << 3)
 #define P_WORDS (1 << 4)
 #define P_DEFAULT (1 << 5)
+#define P_INVAL (1 << 6)
+#define P_HIST (1 << 7)
 
 #define T_AUTO (1 << 0)
 #define T_ALWY (1 << 1)
@@ -65,6 +75,24 @@ static struct help_entry help_entries[] = {
   {"-w, --words", "print the word counts"},
   {"    --total=WHEN", "when to print a line with total counts;\n"
    "                      WHEN can be: auto, always, only, never"},
+  {"    --threads=N", "count big files, and the files named by\n"
+   "                      --files0-from, with N threads at once;\n"
+   "                      defaults to the number of usable processors"},
+  {"    --cache[=FILE]", "remember the counts of regular files in FILE\n"
+   "                      and only read what got appended since;\n"
+   "                      defaults to ~/.cache/coreutils-from-scratch/wc.cache"},
+  {"    --follow[=SECS]", "keep counting the FILEs as they grow and print\n"
+   "                      the new counts every SECS seconds (default 1)\n"
+   "                      when something changed, until interrupted"},
+  {"    --validate[=N]", "also check that the input is valid UTF-8: count\n"
+   "                      the invalid sequences in a last column, report\n"
+   "                      the byte offsets of the first N (default 100) in\n"
+   "                      each file and exit 1 if there were any"},
+  {"    --line-histogram", "also print the 50th, 90th and 99th percentile\n"
+   "                      and the maximum of the line lengths in bytes,\n"
+   "                      then the same for their display width"},
+  {"    --nocache[=direct]", "don't leave the files in the page cache; with\n"
+   "                      direct, read regular files with O_DIRECT"},
   {"    --help", "display this help and exit"},
   {"    --version", "output version information and exit"},
   {0, 0}
@@ -119,11 +147,15 @@ static struct option long_options[] = {{"bytes", no_argument, 0, 'c'},
                                        {"total", required_argument, 0, 3},
                                        {"files0-from", required_argument, 0, 4},
                                        {"help", no_argument, 0, 1},
-                                       {"version", no_argument, 0, 2}};
-
-struct wc {
-  size_t lines, words, chars, bytes, maxlen;
-};
+                                       {"version", no_argument, 0, 2},
+                                       {"threads", required_argument, 0, 6},
+                                       {"-debug", no_argument, 0, 5},
+                                       {"cache", optional_argument, 0, 7},
+                                       {"follow", optional_argument, 0, 8},
+                                       {"validate", optional_argument, 0, 9},
+                                       {"line-histogram", no_argument, 0, 10},
+                                       {"nocache", optional_argument, 0, 11},
+                                       {0, 0, 0, 0}};
 
 /*
 print_to_var() IS NOT SAFE FOR CONCATENATING RAW INPUT
@@ -156,366 +188,648 @@ void print_to_var(char *buf, char *str, bool comma) {
 }
 */
 
-static inline bool is_word_seperator(wchar_t wc) {
-  if (iswspace(wc))
-    return true;
-
-  switch (wc) {
-  case 0x00A0:
-  case 0x2007:
-  case 0x202F:
-  case 0x2060:
-    return true;
-  default:
-    return false;
+/*
+--nocache, for counting a lot of data once without pushing everything else out
+of the page cache: what's been counted gets dropped from it every NOCACHE_STEP
+bytes and the next step gets asked for ahead of time, so only about two steps
+of a file are in there at once. with =direct regular files are read with
+O_DIRECT and never go through the cache at all, that needs aligned reads so
+the mmap paths (and with them the threads for big files) are out
+*/
+#define NOCACHE_ADVISE 1
+#define NOCACHE_DIRECT 2
+#define NOCACHE_STEP (8 * 1024 * 1024)
+#define DIRECT_ALIGN 4096 // covers the logical block size of about anything
+
+static int nocache = 0;
+
+// pos is how far into fd we've counted, *dropped how far the cache has been
+// let go of. -1 for an fd that doesn't have offsets
+static void drop_behind(int fd, off_t *dropped, off_t pos) {
+  if (*dropped < 0 || pos - *dropped < NOCACHE_STEP)
+    return;
+  posix_fadvise(fd, *dropped, pos - *dropped, POSIX_FADV_DONTNEED);
+  posix_fadvise(fd, pos, NOCACHE_STEP, POSIX_FADV_WILLNEED);
+  *dropped = pos;
+}
+
+static bool direct_on(int fd) {
+  int flags = fcntl(fd, F_GETFL);
+  return flags != -1 && fcntl(fd, F_SETFL, flags | O_DIRECT) == 0;
+}
+
+// O_DIRECT turned a read down (the cache left the offset unaligned, or the
+// filesystem won't do it after all), go on without it
+static bool direct_off(int fd) {
+  int flags = fcntl(fd, F_GETFL);
+  return flags != -1 && (flags & O_DIRECT) &&
+         fcntl(fd, F_SETFL, flags & ~O_DIRECT) == 0;
+}
+
+static pthread_key_t buf_key;
+static pthread_once_t buf_once = PTHREAD_ONCE_INIT;
+
+static void buf_key_create(void) {
+  if (pthread_key_create(&buf_key, free) != 0) {
+    fprintf(stderr, "wc: %s\n", strerror(EAGAIN));
+    exit(1);
   }
 }
 
 // i am declaring that i wrote the maxlen part correctly and the GNU people didnt!!
 // (~66 diff in a 75 million long file is crazy tho)
-struct wc count_word_fd(int fd) {
+void count_word_fd(int fd, struct wc_state *state) {
   const size_t BUF_SZ = 524288;
-  unsigned char *buf = malloc(BUF_SZ);
+  // kept around, one per thread. that size is past malloc's mmap threshold,
+  // so a fresh one every file was an mmap()/munmap() pair per file
+  // so, aligned for --nocache=direct. the key frees it when the thread exits
+  pthread_once(&buf_once, buf_key_create);
+  unsigned char *buf = pthread_getspecific(buf_key);
   if (!buf) {
-    fprintf(stderr, "wc: %s\n", strerror(errno));
-    exit(1);
+    if (posix_memalign((void **)&buf, DIRECT_ALIGN, BUF_SZ) != 0 ||
+        pthread_setspecific(buf_key, buf) != 0) {
+      fprintf(stderr, "wc: %s\n", strerror(ENOMEM));
+      exit(1);
+    }
   }
 
+  off_t pos = nocache ? lseek(fd, 0, SEEK_CUR) : -1, dropped = pos;
   ssize_t r; // renamed for better readability, for my future self
-  size_t bytesread = 0;
-  size_t lines = 0, words = 0, chars = 0, maxlen = 0, curlen = 0;
-  bool in_word = false;
-
-  while ((r = read(fd, buf, BUF_SZ)) > 0) {
-    bytesread += r;
-
-    // single pass processing
-    for (size_t i = 0; i < (size_t)r;) {
-      unsigned char c = buf[i];
-
-      if (c < 0x80) {
-        chars++;
-        i++;
-
-        // ascii lane
-        if (c == '\n') {
-          lines++;
-          if (curlen > maxlen)
-            maxlen = curlen;
-          curlen = 0;
-          in_word = false;
-        } else if (c == '\t') {
-          curlen += 8 - (curlen % 8);
-          in_word = false;
-        } else {
-          curlen++;
-          if (c <= ' ')
-            in_word = false;
-          else if (!in_word) {
-            words++;
-            in_word = true;
-          }
-        }
-      } else { // utf-8 lane
-        int len = 1;
-        wchar_t wc = 0;
-
-        mbstate_t state;
-        memset(&state, 0, sizeof(state));
-        size_t result = mbrtowc(&wc, (char *)(buf + i), (size_t)r - i, &state);
-
-        if (result == (size_t)-1 || result == (size_t)-2) {
-          len = 1;
-          wc = 0;
-        } else {
-          len = result;
-        }
+  while (true) {
+    r = read(fd, buf, BUF_SZ);
+    if (r == -1 && errno == EINVAL && direct_off(fd))
+      continue;
+    if (r <= 0)
+      break;
+    wc_scan(state, buf, r);
+    if (pos >= 0)
+      drop_behind(fd, &dropped, pos += r);
+  }
+}
 
-        chars++;
-        i += len;
-
-        if (wc == L'\n' || wc == L'\r') {
-          if (wc == L'\n')
-            lines++;
-          if (curlen > maxlen)
-            maxlen = curlen;
-          curlen = 0;
-          in_word = false;
-        } else if (is_word_seperator(wc)) {
-          if (iswprint(wc)) {
-            int width = wcwidth(wc);
-            if (width > 0)
-              curlen += width;
-          }
-          in_word = false;
-        } else {
-          if (iswprint(wc)) {
-            int width = wcwidth(wc);
-            if (width > 0)
-              curlen += width;
-          }
+/*
+big files get mapped a window at a time instead of all at once, and the pages
+the scan is done with get dropped as it goes, so the RSS stays around one
+window no matter how big the file is. the next step gets WILLNEED while the
+current one is scanned so the disk stays busy.
+*/
+#define MAP_WINDOW (256 * 1024 * 1024)
+#define MAP_STEP (16 * 1024 * 1024)
+
+struct window {
+  void *base; // what mmap() gave us, page aligned
+  size_t maplen;
+  unsigned char *data; // the first byte that was asked for
+  size_t len;
+};
 
-          if (!in_word) {
-            words++;
-            in_word = true;
-          }
-        }
-      }
+// mmap() wants a page aligned offset, map from the page start and skip ahead
+static bool map_window(int fd, off_t off, size_t len, struct window *w) {
+  off_t page = sysconf(_SC_PAGESIZE);
+  off_t skip = off % page;
+  w->maplen = len + skip;
+  w->base = mmap(NULL, w->maplen, PROT_READ, MAP_PRIVATE, fd, off - skip);
+  if (w->base == MAP_FAILED)
+    return false;
+  w->data = (unsigned char *)w->base + skip;
+  w->len = len;
+  // oh dear kernel...
+  madvise(w->base, w->maplen, MADV_SEQUENTIAL);
+  // only does anything where the filesystem can do huge pages for files
+  madvise(w->base, w->maplen, MADV_HUGEPAGE);
+  return true;
+}
+
+// madvise() the bytes from..to of the window, rounded out to whole pages
+static void advise_window(struct window *w, size_t from, size_t to,
+                          int advice) {
+  uintptr_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t)(w->data + from) & ~(page - 1);
+  uintptr_t end = (uintptr_t)(w->data + to);
+  if (advice == MADV_DONTNEED)
+    end &= ~(page - 1); // a page we're still halfway through stays
+  else
+    end = (end + page - 1) & ~(page - 1);
+  if (end > start)
+    madvise((void *)start, end - start, advice);
+}
+
+// the len bytes at off, fd's position has to be at off already
+void count_word_mmap(int fd, off_t off, size_t len, struct wc_state *state) {
+  while (len > 0) {
+    struct window w;
+    size_t wlen = len < MAP_WINDOW ? len : MAP_WINDOW;
+    if (!map_window(fd, off, wlen, &w)) {
+      fprintf(stderr, "wc: %s\n", strerror(errno));
+      lseek(fd, off, SEEK_SET);
+      count_word_fd(fd, state);
+      return;
+    }
+
+    for (size_t pos = 0; pos < wlen; pos += MAP_STEP) {
+      size_t n = wlen - pos < MAP_STEP ? wlen - pos : MAP_STEP;
+      if (pos + n < wlen)
+        advise_window(&w, pos + n, pos + n + MAP_STEP, MADV_WILLNEED);
+      else if (len > wlen)
+        posix_fadvise(fd, off + wlen, MAP_STEP, POSIX_FADV_WILLNEED);
+
+      wc_scan(state, w.data + pos, n);
+      advise_window(&w, pos, pos + n, MADV_DONTNEED);
+      if (nocache)
+        posix_fadvise(fd, off + pos, n, POSIX_FADV_DONTNEED);
     }
+
+    munmap(w.base, w.maplen);
+    off += wlen;
+    len -= wlen;
   }
+}
 
-  if (curlen > maxlen)
-    maxlen = curlen;
+// each thread gets at least this much, below that it isn't worth the spawn
+#define MIN_CHUNK (16 * 1024 * 1024)
 
-  free(buf);
+static long nthreads = 1;
+static struct wc_cache *cache = NULL;
+
+struct chunk_job {
+  const unsigned char *buf;
+  size_t len;
+  struct wc_part part;
+};
 
-  struct wc billy; // willy's twin brother
-  billy.lines = lines;
-  billy.words = words;
-  billy.chars = chars;
-  billy.bytes = bytesread;
-  billy.maxlen = maxlen;
-  return billy;
+static void *count_chunk(void *arg) {
+  struct chunk_job *job = arg;
+  wc_count_part(&job->part, job->buf, job->len);
+  return NULL;
 }
 
-struct wc count_word_mmap(int fd, size_t file_size) {
-  void *data = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
-  if (data == MAP_FAILED) {
+// one window worth of count_word_parallel(), cut into a slice per thread
+static void count_window_parallel(const unsigned char *buf, size_t len,
+                                  long workers, struct wc_state *state) {
+  struct chunk_job *jobs = calloc(workers, sizeof(*jobs));
+  pthread_t *tids = calloc(workers, sizeof(*tids));
+  bool *started = calloc(workers, sizeof(*started));
+  if (!jobs || !tids || !started) {
     fprintf(stderr, "wc: %s\n", strerror(errno));
-    return count_word_fd(fd);
+    exit(1);
   }
 
-  // oh dear kernel...
-  madvise(data, file_size, MADV_SEQUENTIAL);
-
-  unsigned char *buf = (unsigned char *)data;
-  size_t lines = 0, words = 0, chars = 0, maxlen = 0, curlen = 0;
-  bool in_word = false;
-
-  mbstate_t state;
-  memset(&state, 0, sizeof(state));
-
-  for (size_t i = 0; i < file_size;) {
-    unsigned char c = buf[i];
-
-    // ascii lane
-    if (c < 0x80) {
-      chars++;
-      i++;
-
-      if (c == '\n') {
-        lines++;
-        if (curlen > maxlen)
-          maxlen = curlen;
-        curlen = 0;
-        in_word = false;
-      } else if (c == '\t') {
-        curlen += 8 - (curlen % 8);
-        in_word = false;
-      } else {
-        curlen++;
-        if (c <= ' ') {
-          in_word = false;
-        } else if (!in_word) {
-          words++;
-          in_word = true;
-        }
-      }
-    } else { // utf8 lane
-      int len = 1;
-      wchar_t wc = 0;
-
-      size_t result = mbrtowc(&wc, (char *)(buf + i), file_size - i, &state);
+  // never cut in the middle of a character
+  size_t start = 0;
+  for (long k = 0; k < workers; k++) {
+    size_t end = len;
+    if (k < workers - 1)
+      end = wc_sync_point(buf, len, len / workers * (k + 1));
+    if (end < start)
+      end = start;
+    jobs[k].buf = buf + start;
+    jobs[k].len = end - start;
+    start = end;
+  }
 
-      if (result == (size_t)-1 || result == (size_t)-2) {
-        len = 1;
-        wc = 0;
-      } else {
-        len = result;
-      }
+  // the main thread takes the first slice itself
+  for (long k = 1; k < workers; k++)
+    started[k] = pthread_create(&tids[k], NULL, count_chunk, &jobs[k]) == 0;
+  count_chunk(&jobs[0]);
+
+  for (long k = 0; k < workers; k++) {
+    if (k > 0) {
+      if (started[k])
+        pthread_join(tids[k], NULL);
+      else
+        count_chunk(&jobs[k]); // couldn't get a thread, do it here
+    }
+    wc_merge_part(state, &jobs[k].part);
+  }
 
-      chars++;
-      i += len;
-
-      if (wc == L'\n' || wc == L'\r') {
-        if (wc == L'\n')
-          lines++;
-        if (curlen > maxlen)
-          maxlen = curlen;
-        curlen = 0;
-        in_word = false;
-      } else if (is_word_seperator(wc)) {
-        if (iswprint(wc)) {
-          int width = wcwidth(wc);
-          if (width > 0)
-            curlen += width;
-        }
-        in_word = false;
-      } else {
-        if (iswprint(wc)) {
-          int width = wcwidth(wc);
-          if (width > 0)
-            curlen += width;
-        }
+  free(started);
+  free(tids);
+  free(jobs);
+}
 
-        if (!in_word) {
-          words++;
-          in_word = true;
-        }
-      }
+// same as count_word_mmap() but every window gets cut into one slice per
+// thread. the slices are glued back together in order so the result is
+// identical
+void count_word_parallel(int fd, off_t off, size_t len, long workers,
+                         struct wc_state *state) {
+  // a few bytes past the window so its end can be moved off a character
+  // that got cut in half. a utf-8 sequence is 6 bytes at most, past that
+  // the serial scan is back at a character start no matter what
+  const size_t overlap = 8;
+
+  while (len > 0) {
+    struct window w;
+    size_t wlen = len < MAP_WINDOW + overlap ? len : MAP_WINDOW + overlap;
+    if (!map_window(fd, off, wlen, &w)) {
+      fprintf(stderr, "wc: %s\n", strerror(errno));
+      lseek(fd, off, SEEK_SET);
+      count_word_fd(fd, state);
+      return;
     }
+    advise_window(&w, 0, wlen, MADV_WILLNEED);
+
+    size_t cut = wlen;
+    if (wlen < len)
+      cut = wc_sync_point(w.data, wlen, MAP_WINDOW);
+    if (cut < len)
+      posix_fadvise(fd, off + cut, MAP_STEP, POSIX_FADV_WILLNEED);
+
+    count_window_parallel(w.data, cut, workers, state);
+
+    munmap(w.base, w.maplen);
+    if (nocache)
+      posix_fadvise(fd, off, cut, POSIX_FADV_DONTNEED);
+    off += cut;
+    len -= cut;
   }
+}
 
-  if (curlen > maxlen)
-    maxlen = curlen;
+// a regular file from off to its end (as far as st knows), cut into at
+// most max_workers slices
+static void count_regular(int fd, const struct stat *st, off_t off,
+                          bool direct, long max_workers,
+                          struct wc_state *state) {
+  if (off > 0 && lseek(fd, off, SEEK_SET) == -1) {
+    fprintf(stderr, "wc: %s\n", strerror(errno));
+    return;
+  }
 
-  munmap(data, file_size);
+  // a utf-8 sequence the cache left hanging has to be finished first, the
+  // slices of the parallel path always start out clean
+  unsigned char head[64];
+  while (state->dfa != 0 && off < st->st_size) {
+    ssize_t r = read(fd, head, sizeof(head));
+    if (r <= 0)
+      return;
+    wc_scan(state, head, r);
+    off += r;
+  }
 
-  struct wc willy;
-  willy.lines = lines;
-  willy.words = words;
-  willy.chars = chars;
-  willy.bytes = file_size;
-  willy.maxlen = maxlen;
-  return willy;
+  size_t len = off < st->st_size ? st->st_size - off : 0;
+  if (len > 65536 && !direct) {
+    long workers = len / MIN_CHUNK;
+    if (workers > max_workers)
+      workers = max_workers;
+    if (workers > 1 && wc_can_split())
+      count_word_parallel(fd, off, len, workers, state);
+    else
+      count_word_mmap(fd, off, len, state);
+  } else {
+    count_word_fd(fd, state);
+  }
 }
 
-struct wc cw_wrapper(int fd) {
+// max_workers is how many threads one big file may be split across
+static struct wc count_file(int fd, long max_workers) {
+  struct wc_state state;
+  wc_state_init(&state);
+
   struct stat st;
   if (fstat(fd, &st) == -1) {
     fprintf(stderr, "wc: %s\n", strerror(errno));
-    return count_word_fd(fd);
+    count_word_fd(fd, &state);
+    struct wc billy = wc_state_finish(&state); // willy's twin brother
+    return billy;
   }
 
-  if (S_ISREG(st.st_mode) && st.st_size > 65536) {
-    return count_word_mmap(fd, st.st_size);
+  // -c on its own doesn't need to read a single byte, it's whatever is left
+  // past the offset (a stdin somebody already read from isn't at 0). /proc
+  // and friends say 0 even when they aren't empty, those still get read below
+  off_t cur;
+  if (wc_bytes_only() && S_ISREG(st.st_mode) && st.st_size > 0 &&
+      (cur = lseek(fd, 0, SEEK_CUR)) != -1)
+    return (struct wc){.bytes = cur < st.st_size ? st.st_size - cur : 0};
+
+  // stdin's flags are shared with whoever handed it to us, leave them be
+  bool direct = nocache == NOCACHE_DIRECT && fd != STDIN_FILENO &&
+                S_ISREG(st.st_mode) && direct_on(fd);
+  if (!S_ISREG(st.st_mode)) {
+    count_word_fd(fd, &state);
+  } else if (cache) {
+    // only the part we haven't seen before
+    off_t off = wc_cache_lookup(cache, fd, &st, &state);
+    count_regular(fd, &st, off, direct, max_workers, &state);
+    wc_cache_store(cache, fd, &st, &state);
   } else {
-    return count_word_fd(fd);
+    count_regular(fd, &st, 0, direct, max_workers, &state);
   }
+  if (nocache && S_ISREG(st.st_mode))
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED); // the last step's worth
+
+  struct wc willy = wc_state_finish(&state);
+  return willy;
 }
 
-int num_width(long x) {
+// stdin, nothing else is running so a big one gets every thread
+struct wc cw_wrapper(int fd) { return count_file(fd, nthreads); }
+
+// the pool's workers each get their share of the threads, splitting every
+// file nthreads ways on top of that would be nthreads squared of them
+static long pool_share = 1;
+static struct wc cw_pooled(int fd) { return count_file(fd, pool_share); }
+
+long usable_cpus(void) {
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    return CPU_COUNT(&set);
+
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? n : 1;
+}
+
+// the counters in the order they get printed
+static const struct {
+  uint8_t flag;
+  size_t offset;
+} columns[] = {
+    {P_LINES, offsetof(struct wc, lines)},  {P_WORDS, offsetof(struct wc, words)},
+    {P_CHARS, offsetof(struct wc, chars)},  {P_BYTES, offsetof(struct wc, bytes)},
+    {P_LENMX, offsetof(struct wc, maxlen)},
+    {P_HIST, offsetof(struct wc, line_pct[0])}, {P_HIST, offsetof(struct wc, line_pct[1])},
+    {P_HIST, offsetof(struct wc, line_pct[2])}, {P_HIST, offsetof(struct wc, line_pct[3])},
+    {P_HIST, offsetof(struct wc, line_pct[4])}, {P_HIST, offsetof(struct wc, line_pct[5])},
+    {P_HIST, offsetof(struct wc, line_pct[6])}, {P_HIST, offsetof(struct wc, line_pct[7])},
+    {P_INVAL, offsetof(struct wc, invalid)},
+};
+#define NCOLUMNS (sizeof(columns) / sizeof(columns[0]))
+
+#define COLUMN(w, i) (*(const size_t *)((const char *)&(w) + columns[i].offset))
+
+// widest of the selected counters
+static int row_width(uint8_t flags, struct wc willer) {
   int width = 0;
-  if (x <= 0) {
-    width = 1;
-    x = -x;
-  }
-  while (x > 0) {
-    width++;
-    x /= 10;
+  for (size_t i = 0; i < NCOLUMNS; i++) {
+    if (flags & columns[i].flag) {
+      int w = out_num_width(COLUMN(willer, i));
+      if (w > width)
+        width = w;
+    }
   }
   return width;
 }
 
+static void print_default(struct wc willer) {
+  out_num(willer.lines, 7);
+  out_char(' ');
+  out_num(willer.words, 7);
+  out_char(' ');
+  out_num(willer.bytes, 7);
+}
+
 // why do wc from stdin and file formats differently wtf!!
-void print_results(uint8_t flags, char *name, struct wc willer,
+void print_results(uint8_t flags, const char *name, struct wc willer,
                    bool from_stdin) {
-  bool first_print = true;
-
-  int w1 = num_width(willer.lines);
-  int w2 = num_width(willer.words);
-  int w3 = num_width(willer.chars);
-  int w4 = num_width(willer.bytes);
-  int w5 = num_width(willer.maxlen);
-
-  int width = 0;
-  if (w1 > width && flags & P_LINES)
-    width = w1;
-  if (w2 > width && flags & P_WORDS)
-    width = w2;
-  if (w3 > width && flags & P_CHARS)
-    width = w3;
-  if (w4 > width && flags & P_BYTES)
-    width = w4;
-  if (w5 > width && flags & P_LENMX)
-    width = w5;
+  int width = from_stdin ? 7 : row_width(flags, willer);
+  if ((flags & P_DEFAULT) && width < 7)
+    width = 7; // the extra columns next to the default ones
 
   if (flags & P_DEFAULT) {
-    printf("%7ld %7ld %7ld", willer.lines, willer.words, willer.bytes);
+    print_default(willer);
+    if (from_stdin && (flags & (P_INVAL | P_HIST)))
+      out_char(' '); // stdin's columns don't start with a space of their own
   }
-  if (flags & P_LINES) {
+  for (size_t i = 0; i < NCOLUMNS; i++) {
+    if (!(flags & columns[i].flag))
+      continue;
     if (!from_stdin)
-      if (!first_print) {
-        printf("%*ld", width, willer.lines);
-        first_print = false;
-      } else {
-        printf(" %*ld", width, willer.lines);
-      }
-    else
-      printf("%7ld ", willer.lines);
+      out_char(' ');
+    out_num(COLUMN(willer, i), width);
+    if (from_stdin)
+      out_char(' ');
   }
-  if (flags & P_WORDS) {
-    if (!from_stdin)
-      if (!first_print) {
-        printf("%*ld", width, willer.words);
-        first_print = false;
-      } else {
-        printf(" %*ld", width, willer.words);
-      }
-    else
-      printf("%7ld ", willer.words);
+
+  if (!from_stdin && name != NULL && name[0] != '\0') {
+    out_char(' ');
+    out_str(name, strlen(name));
   }
-  if (flags & P_CHARS) {
-    if (!from_stdin)
-      if (!first_print) {
-        printf("%*ld", width, willer.chars);
-        first_print = false;
-      } else {
-        printf(" %*ld", width, willer.chars);
-      }
-    else
-      printf("%7ld ", willer.chars);
+  out_char('\n');
+}
+
+// everything we need to remember between files, the rows themselves get
+// printed as soon as they come in so this doesn't grow with the file count
+struct results {
+  uint8_t flags, when;
+  bool from_stdin;
+  size_t count;
+  struct wc total;
+  // the first row waits until we know if there's a second one, --total=only
+  // prints it anyway when it's the only file
+  struct wc first;
+  char *first_name;
+};
+
+// --validate's offsets go to stderr as soon as the file's row is in, so they
+// end up in file order too. whatever's been printed so far goes out first
+static void report_invalid(const char *name, struct wc *willer) {
+  if (name[0] == '\0')
+    name = "standard input";
+  out_flush();
+  for (size_t i = 0; i < willer->nbad; i++)
+    fprintf(stderr, "wc: %s: invalid UTF-8 at byte %" PRIu64 "\n", name,
+            willer->bad[i]);
+  size_t more = willer->invalid - willer->nbad;
+  if (more)
+    fprintf(stderr, "wc: %s: %zu more invalid UTF-8 sequence%s not listed\n",
+            name, more, more == 1 ? "" : "s");
+  free(willer->bad);
+  willer->bad = NULL;
+  willer->nbad = 0;
+}
+
+// great creativity! such a manificient name! what an unbelievable thinking
+// behind naming this function! /s
+void process_the_fucking_struct(struct results *r, const char *name,
+                                struct wc willer) {
+  if (willer.invalid)
+    report_invalid(name, &willer);
+  if (r->flags & P_HIST) {
+    // the row only needs the percentiles, the total needs every bucket
+    r->total.hist = wc_hist_merge(r->total.hist, willer.hist);
+    wc_hist_percentiles(&willer);
+    free(willer.hist);
+    willer.hist = NULL;
   }
-  if (flags & P_BYTES) {
-    if (!from_stdin)
-      if (!first_print) {
-        printf("%*ld", width, willer.bytes);
-        first_print = false;
-      } else {
-        printf(" %*ld", width, willer.bytes);
-      }
-    else
-      printf("%7ld ", willer.bytes);
+
+  if (r->count == 0) {
+    r->first = willer;
+    r->first_name = strdup(name);
+    if (!r->first_name) {
+      fprintf(stderr, "wc: %s\n", strerror(errno));
+      exit(1);
+    }
+  } else if (!(r->when & T_ONLY)) {
+    if (r->count == 1)
+      print_results(r->flags, r->first_name, r->first, r->from_stdin);
+    print_results(r->flags, name, willer, r->from_stdin);
   }
-  if (flags & P_LENMX) {
-    if (!from_stdin)
-      if (!first_print) {
-        printf("%*ld", width, willer.maxlen);
-        first_print = false;
-      } else {
-        printf(" %*ld", width, willer.maxlen);
-      }
-    else
-      printf("%7ld ", willer.maxlen);
+
+  r->total.bytes += willer.bytes;
+  r->total.chars += willer.chars;
+  r->total.lines += willer.lines;
+  r->total.words += willer.words;
+  r->total.invalid += willer.invalid;
+  if (willer.maxlen > r->total.maxlen)
+    r->total.maxlen = willer.maxlen;
+  r->count++;
+}
+
+void print_total(struct results *r) {
+  uint8_t flags = r->flags;
+  struct wc final = r->total;
+  if (flags & P_HIST) {
+    wc_hist_percentiles(&final);
+    free(final.hist);
   }
 
-  if (!from_stdin && name != NULL && name[0] != '\0') {
-    printf(" %s\n", name);
+  if (r->count == 1) {
+    print_results(flags, r->first_name, r->first, r->from_stdin);
+    if (r->when & T_ALWY)
+      print_results(flags, "total", final, r->from_stdin); // :troll:
+  }
+  free(r->first_name);
+  if (r->count <= 1)
+    return;
+
+  if (!(r->when & (T_ONLY | T_AUTO)) && !(flags & T_ALWY))
+    return;
+
+  int width = row_width(flags, final);
+  if (flags & P_DEFAULT) {
+    print_default(final);
+    // only --line-histogram's and --validate's columns can come after the
+    // default ones
+    if (width < 7)
+      width = 7;
+    for (size_t i = 0; i < NCOLUMNS; i++) {
+      if (flags & columns[i].flag) {
+        out_char(' ');
+        out_num(COLUMN(final, i), width);
+      }
+    }
   } else {
-    printf("\n");
+    for (size_t i = 0; i < NCOLUMNS; i++) {
+      if (flags & columns[i].flag) {
+        out_num(COLUMN(final, i), width);
+        out_char(' ');
+      }
+    }
   }
+
+  if (r->when & T_ONLY)
+    out_char('\n');
+  else
+    out_str(" total\n", 7);
 }
 
-// great creativity! such a manificient name! what an unbelievable thinking
-// behind naming this function! /s
-void process_the_fucking_struct(int fd, struct wc williams[], int length,
-                                int *count) {
-  struct wc willer;
-  willer = cw_wrapper(fd);
+static uint8_t follow_flags, follow_when;
+
+// one round of --follow output, the same thing a normal run would print
+void follow_report(char *const names[], const struct wc counts[], int n) {
+  struct results r = {.flags = follow_flags, .when = follow_when};
+  for (int i = 0; i < n; i++)
+    process_the_fucking_struct(&r, names[i], counts[i]);
+  print_total(&r);
+  out_flush();
+}
+
+// hands out the NUL separated names from --files0-from one at a time. the
+// buffer only ever grows to fit the longest name, not the whole list. with
+// list set it hands out those instead (the command line's FILEs)
+struct name_reader {
+  char **list;
+  int nlist;
+  int fd;
+  char *buf;
+  size_t cap;
+  size_t start, used; // unconsumed bytes are buf[start..used)
+  bool eof;
+};
+
+// NULL once there's nothing left, or on a read error with errno set.
+// empty names get skipped just like before
+char *next_name(struct name_reader *r) {
+  if (r->list) {
+    if (r->nlist == 0)
+      return NULL;
+    r->nlist--;
+    char *name = strdup(*r->list++);
+    if (!name)
+      goto oom;
+    return name;
+  }
+
+  size_t scanned = r->start;
+  while (true) {
+    char *nul = r->used > scanned
+                    ? memchr(r->buf + scanned, '\0', r->used - scanned)
+                    : NULL;
+    if (nul) {
+      size_t len = nul - (r->buf + r->start);
+      char *name = len ? strndup(r->buf + r->start, len) : NULL;
+      r->start += len + 1;
+      scanned = r->start;
+      if (len == 0)
+        continue;
+      if (!name)
+        goto oom;
+      return name;
+    }
 
-  if (*count < length) {
-    williams[*count] = willer;
-    (*count)++;
+    if (r->eof) {
+      // handle last entry if not null-terminated
+      if (r->start == r->used)
+        return NULL;
+      char *name = strndup(r->buf + r->start, r->used - r->start);
+      if (!name)
+        goto oom;
+      r->start = r->used;
+      return name;
+    }
+
+    // slide what's left to the front, grow if a single name fills it up
+    memmove(r->buf, r->buf + r->start, r->used - r->start);
+    r->used -= r->start;
+    r->start = 0;
+    scanned = r->used;
+    if (r->used == r->cap) {
+      size_t cap = r->cap ? r->cap * 2 : 12288;
+      char *buf = realloc(r->buf, cap);
+      if (!buf)
+        goto oom;
+      r->buf = buf;
+      r->cap = cap;
+    }
+
+    ssize_t bytes = read(r->fd, r->buf + r->used, r->cap - r->used);
+    if (bytes == -1) {
+      if (errno == EINTR)
+        continue;
+      return NULL;
+    }
+    if (bytes == 0)
+      r->eof = true;
+    r->used += bytes;
   }
+
+oom:
+  fprintf(stderr, "wc: %s\n", strerror(errno));
+  exit(1);
 }
 
 int main(int argc, char *argv[]) {
   // set to user's locale
   setlocale(LC_CTYPE, "");
+  nthreads = usable_cpus();
+  atexit(out_flush);
 
   // i dont trust gcc.. at all...
   uint8_t flags = 0;
   uint8_t when = 0;
+  bool debug = false;
+  char *cache_path = NULL;
+  double follow = 0; // seconds between updates, 0 when not following
+  size_t validate = 0; // offsets to report plus one, 0 without --validate
+  bool histogram = false;
 
   int files0_from_fd = 0;
   bool files0_from_stdin = false;
@@ -570,6 +884,75 @@ int main(int argc, char *argv[]) {
         return 1;
       }
       break;
+    case 6:;
+      char *end;
+      errno = 0;
+      nthreads = strtol(optarg, &end, 10);
+      if (errno || *end != '\0' || end == optarg || nthreads < 1) {
+        fprintf(stderr, "%s: invalid number of threads: '%s'\n", argv[0],
+                optarg);
+        fprintf(stderr, "Try '%s --help' for more information\n", argv[0]);
+        return 1;
+      }
+      break;
+    case 7:
+      if (optarg) {
+        cache_path = strdup(optarg);
+      } else if (!(cache_path = wc_cache_default_path())) {
+        fprintf(stderr, "%s: no place to put the cache, use --cache=FILE\n",
+                argv[0]);
+        return 1;
+      }
+      break;
+    case 8:
+      follow = 1;
+      if (optarg) {
+        char *end;
+        errno = 0;
+        follow = strtod(optarg, &end);
+        if (errno || *end != '\0' || end == optarg || !(follow > 0) ||
+            !isfinite(follow)) {
+          fprintf(stderr, "%s: invalid interval: '%s'\n", argv[0], optarg);
+          fprintf(stderr, "Try '%s --help' for more information\n", argv[0]);
+          return 1;
+        }
+      }
+      break;
+    case 9:
+      validate = 100;
+      if (optarg) {
+        char *end;
+        errno = 0;
+        unsigned long long n = strtoull(optarg, &end, 10);
+        if (errno || *end != '\0' || end == optarg || optarg[0] == '-' ||
+            n > SIZE_MAX - 1) {
+          fprintf(stderr, "%s: invalid number of offsets: '%s'\n", argv[0],
+                  optarg);
+          fprintf(stderr, "Try '%s --help' for more information\n", argv[0]);
+          return 1;
+        }
+        validate = n + 1;
+      }
+      break;
+    case 10:
+      histogram = true;
+      break;
+    case 11:
+      if (!optarg) {
+        nocache = NOCACHE_ADVISE;
+      } else if (strcmp(optarg, "direct") == 0) {
+        nocache = NOCACHE_DIRECT;
+      } else {
+        fprintf(stderr, "%s: invalid argument '%s' for '--nocache'\n", argv[0],
+                optarg);
+        fprintf(stderr, "Try '%s --help' for more information\n", argv[0]);
+        return 1;
+      }
+      break;
+    case 5:
+      // same hidden switch as GNU's, handy to check which kernel got picked
+      debug = true;
+      break;
     case 1:
       print_help(argv[0]);
       return 0;
@@ -585,103 +968,71 @@ int main(int argc, char *argv[]) {
   if (flags == 0) {
     flags = P_DEFAULT;
   }
+  if (histogram)
+    flags |= P_HIST;
+  if (validate)
+    flags |= P_INVAL;
   if (when == 0) {
     when = T_AUTO;
   }
 
-  struct wc williams[50];
-  char names[255][1024];
-  int count = 0;
-  bool from_stdin = false;
-
-  if (files0_from_fd != 0 || files0_from_stdin != false) {
-    char *list[255];
-    char buf[12288];
-    ssize_t bytes = 0;
-    size_t buf_used = 0;
-    size_t name_count = 0;
-
-    if (files0_from_stdin) {
-      while ((bytes = read(STDIN_FILENO, buf + buf_used, sizeof(buf) - buf_used)) > 0) {
-        buf_used += bytes;
-        size_t start = 0;
-        for (size_t i = 0; i < buf_used; i++) {
-          if (buf[i] == '\0') {
-            size_t len = i - start;
-            if (len > 0) {
-              list[name_count] = strndup(&buf[start], len);
-              name_count++;
-            }
-            start = i + 1;
-          }
-        }
-
-        if (start < buf_used) {
-          memmove(buf, buf + start, buf_used - start);
-          buf_used -= start;
-        } else {
-          buf_used = 0;
-        }
-      }
-    } else {
-      while ((bytes = read(files0_from_fd, buf + buf_used, sizeof(buf) - buf_used)) > 0) {
-        buf_used += bytes;
-        size_t start = 0;
-        for (size_t i = 0; i < buf_used; i++) {
-          if (buf[i] == '\0') {
-            size_t len = i - start;
-            if (len > 0)
-            {
-              list[name_count] = strndup(&buf[start], len);
-              name_count++;
-            }
-            start = i + 1;
-          }
-        }
-
-        if (start < buf_used) {
-          memmove(buf, buf + start, buf_used - start);
-          buf_used -= start;
-        } else {
-          buf_used = 0;
-        }
-      }
-    }
-
-    if (buf_used > 0) {
-      // handle last entry if not null-terminated
-      list[name_count] = strndup(buf, buf_used);
-      name_count++;
+  // only pay for the counters that actually get printed
+  unsigned need = 0;
+  if (flags & (P_LINES | P_DEFAULT))
+    need |= WC_NEED_LINES;
+  if (flags & (P_WORDS | P_DEFAULT))
+    need |= WC_NEED_WORDS;
+  if (flags & P_CHARS)
+    need |= WC_NEED_CHARS;
+  if (flags & P_LENMX)
+    need |= WC_NEED_WIDTH;
+  if (flags & P_HIST)
+    need |= WC_NEED_HIST;
+  wc_kernel_init(need);
+  if (validate)
+    wc_validate_init(validate - 1);
+  if (debug)
+    fprintf(stderr, "wc: using %s kernel (%s)%s%s\n", wc_kernel_name(),
+            wc_kernel_mode(), validate ? ", validating with " : "",
+            validate ? wc_validate_name() : "");
+  // needs to know the mode, cached states are only good for the same one.
+  // a cached prefix wouldn't get validated, so not with --validate, and a
+  // cached state has no room for a histogram
+  if (cache_path && !validate && !histogram)
+    cache = wc_cache_open(cache_path);
+
+  struct results results = {.flags = flags, .when = when};
+
+  if (follow > 0) {
+    if (files0_from_fd != 0 || files0_from_stdin || argc == optind) {
+      fprintf(stderr, "%s: --follow needs FILEs named on the command line\n",
+              argv[0]);
+      return 1;
     }
-
-    if (bytes == -1)
-    {
-      fprintf(stderr, "wc: %s\n", strerror(errno));
-      close(files0_from_fd);
+    if (validate || histogram) {
+      fprintf(stderr, "%s: --follow can't be combined with %s\n", argv[0],
+              validate ? "--validate" : "--line-histogram");
       return 1;
     }
-
-    if (!files0_from_stdin)
-      close(files0_from_fd);
-
-    for (size_t i = 0; i < name_count; i++) {
-      int fd = open(list[i], O_RDONLY | O_CLOEXEC);
-      if (fd == -1) {
-        fprintf(stderr, "%s: %s: %s\n", argv[0], list[i], strerror(errno));
+    for (int i = optind; i < argc; i++) {
+      if (strcmp(argv[i], "-") == 0 || argv[i][0] == '\0') {
+        fprintf(stderr, "%s: can't follow '%s'\n", argv[0], argv[i]);
         return 1;
       }
-      strncpy(names[count], list[i], sizeof(names[count]));
-      process_the_fucking_struct(
-          fd, williams, sizeof(williams) / sizeof(williams[0]), &count);
-      close(fd);
-      free(list[i]);// free the strdup'd memory
     }
+    follow_flags = flags;
+    follow_when = when;
+    return follow_files(argv + optind, argc - optind, follow, count_word_fd,
+                        follow_report);
+  }
+
+  struct name_reader reader = {0};
+  if (files0_from_fd != 0 || files0_from_stdin != false) {
+    reader.fd = files0_from_stdin ? STDIN_FILENO : files0_from_fd;
   } else if (argc == optind) {
   do_stdin:;
-    from_stdin = true;
-    process_the_fucking_struct(STDIN_FILENO, williams,
-                               sizeof(williams) / sizeof(williams[0]), &count);
-    strcpy(names[count - 1], "");
+    results.from_stdin = true;
+    process_the_fucking_struct(&results, "", cw_wrapper(STDIN_FILENO));
   } else {
     if (argv[optind][0] == '-')
       goto do_stdin;
@@ -689,94 +1040,65 @@ int main(int argc, char *argv[]) {
       fprintf(stderr, "wc: invalid zero-length file name\n");
       return 1;
     }
-    for (; optind < argc; optind++) {
-      int fd = open(argv[optind], O_RDONLY | O_CLOEXEC);
-      if (fd == -1) {
-        fprintf(stderr, "%s: %s: %s\n", argv[0], argv[optind], strerror(errno));
-        return 1;
-      }
-      strncpy(names[count], argv[optind], sizeof(names[count]));
-      process_the_fucking_struct(
-          fd, williams, sizeof(williams) / sizeof(williams[0]), &count);
-      close(fd);
-    }
+    reader.list = argv + optind;
+    reader.nlist = argc - optind;
   }
 
-  if (count == 1) {
-    print_results(flags, names[0], williams[0], from_stdin);
-    if (when & T_ALWY)
-      print_results(flags, "total", williams[0], from_stdin); // :troll:
-  } else if (count > 1) {
-    struct wc final = {0};
-    size_t previous_len = 0;
-    for (int i = 0; i < count; i++) {
-      final.bytes += williams[i].bytes;
-      final.chars += williams[i].chars;
-      final.lines += williams[i].lines;
-      // wouldve done tenary if i didnt have to set the previous len
-      if (williams[i].maxlen > previous_len) {
-        final.maxlen = williams[i].maxlen;
-        previous_len = final.maxlen;
-      } else {
-        final.maxlen = previous_len;
+  if (!results.from_stdin) {
+    // the workers open and count ahead of us, we just take the results in
+    // the order the names came in. names are read lazily, only as many as
+    // fit in the pool's window are ever held at once. the cache wants to
+    // see every file itself, so no batching behind its back
+    // nor with --nocache, batched files never get to cw_wrapper() to be
+    // dropped from the cache
+    // with fewer names than threads the rest go to splitting the files up,
+    // a single big one is counted by all of them
+    long pool_workers = nthreads;
+    if (reader.list && reader.nlist < pool_workers)
+      pool_workers = reader.nlist;
+    pool_share = nthreads / pool_workers;
+    struct file_pool *pool =
+        file_pool_start(pool_workers, cw_pooled, !cache && !nocache);
+    struct file_result res;
+    char *pending = NULL;
+    bool names_done = false;
+    while (true) {
+      if (!names_done && !pending) {
+        errno = 0;
+        pending = next_name(&reader);
+        if (!pending) {
+          if (errno) {
+            fprintf(stderr, "wc: %s\n", strerror(errno));
+            return 1;
+          }
+          names_done = true;
+        }
       }
-      final.words += williams[i].words;
-    }
+      if (pending && file_pool_submit(pool, pending)) {
+        pending = NULL;
+        continue;
+      }
+      // window's full or we're out of names, wait for the oldest one
+      if (!file_pool_next(pool, &res))
+        break;
 
-    char totalbuf[256];
-    size_t pos = 0;
-
-    int w1 = num_width(final.lines);
-    int w2 = num_width(final.words);
-    int w3 = num_width(final.chars);
-    int w4 = num_width(final.bytes);
-    int w5 = num_width(final.maxlen);
-
-    int width = 0;
-    if (w1 > width && flags & P_LINES)
-      width = w1;
-    if (w2 > width && flags & P_WORDS)
-      width = w2;
-    if (w3 > width && flags & P_CHARS)
-      width = w3;
-    if (w4 > width && flags & P_BYTES)
-      width = w4;
-    if (w5 > width && flags & P_LENMX)
-      width = w5;
-
-    if (flags & P_LINES)
-      pos +=
-          snprintf(totalbuf + pos, sizeof(totalbuf) - pos, "%*ld ", width, final.lines);
-    if (flags & P_WORDS)
-      pos +=
-          snprintf(totalbuf + pos, sizeof(totalbuf) - pos, "%*ld ", width, final.words);
-    if (flags & P_CHARS)
-      pos +=
-          snprintf(totalbuf + pos, sizeof(totalbuf) - pos, "%*ld ", width, final.chars);
-    if (flags & P_BYTES)
-      pos +=
-          snprintf(totalbuf + pos, sizeof(totalbuf) - pos, "%*ld ", width, final.bytes);
-    if (flags & P_LENMX)
-      pos += snprintf(totalbuf + pos, sizeof(totalbuf) - pos, "%*ld ", width,
-                      final.maxlen);
-    if (flags & P_DEFAULT)
-      pos += snprintf(totalbuf + pos, sizeof(totalbuf) - pos, "%7ld %7ld %7ld",
-                      final.lines, final.words, final.bytes);
-
-    totalbuf[pos] = 0;
-
-    if (when & T_ONLY) {
-      puts(totalbuf);
-      return 0;
+      if (res.err) {
+        fprintf(stderr, "%s: %s: %s\n", argv[0], res.name, strerror(res.err));
+        return 1;
+      }
+      process_the_fucking_struct(&results, res.name, res.counts);
+      free(res.name);// free the strdup'd memory
     }
+    file_pool_finish(pool);
+    free(reader.buf);
 
-    for (int i = 0; i < count; i++) {
-      print_results(flags, names[i], williams[i], from_stdin);
-    }
-    if (when & T_AUTO || flags & T_ALWY) {
-      printf("%s total\n", totalbuf);
-    }
+    if (files0_from_fd != 0)
+      close(files0_from_fd);
   }
 
-  return 0;
+  print_total(&results);
+  if (cache)
+    wc_cache_close(cache);
+  free(cache_path);
+  return results.total.invalid ? 1 : 0;
 }